@@ -16,6 +16,8 @@ conge_init (void)
   ctx->fps = 0;
   ctx->ticks = 0;
   ctx->elapsed = 0.0;
+  ctx->delta = 0.0;
+  ctx->timestep = 1.0 / 60;
 
   ctx->scroll = 0;
 
@@ -28,10 +30,36 @@ conge_init (void)
   strcpy (ctx->title, "ConGE");
 
   ctx->frame = NULL;
-
-  ctx->_input = GetStdHandle (STD_INPUT_HANDLE);
-  ctx->_output = GetStdHandle (STD_OUTPUT_HANDLE);
-  ctx->_window = GetConsoleWindow ();
+  ctx->wide_frame = NULL;
+  ctx->format = CONGE_FORMAT_NARROW;
+  ctx->subframe = NULL;
+  ctx->subpixels = CONGE_SUBPIXELS_NONE;
+  ctx->sub_rows = 0;
+  ctx->sub_cols = 0;
+  ctx->retain = 0;
+  ctx->idle = 0;
+  ctx->idle_timeout = 0.0;
+
+  ctx->rows = 0;
+  ctx->cols = 0;
+
+  ctx->_backend = &conge_console_backend;
+  ctx->_headless = NULL;
+  ctx->_open = 0;
+  ctx->_pool = NULL;
+  ctx->_input_threaded = 0;
+  ctx->_input_queue = NULL;
+  ctx->_presenter = NULL;
+  ctx->_swaps_wanted = 1;
+  ctx->_frames_submitted = 0;
+  ctx->_frames_presented = 0;
+
+  ctx->_update = NULL;
+  ctx->_render = NULL;
+  ctx->_update_step = 0.0;
+  ctx->_accumulator = 0.0;
+
+  conge_init_console (ctx);
 
   for (i = 0; i < CONGE__KEYS_LENGTH; i++)
     {
@@ -39,18 +67,103 @@ conge_init (void)
       ctx->_prev_keys[i] = 0;
     }
 
+  ctx->_event_first = 0;
+  ctx->_event_count = 0;
+
   ctx->_buttons = 0;
 
-  ctx->_cursor_x = 0;
-  ctx->_cursor_y = 0;
+  /* We don't know where the cursor is, nor its color. */
+  ctx->_cursor_x = -1;
+  ctx->_cursor_y = -1;
+
+  ctx->_last_color = -1;
+  ctx->_last_fg = CONGE__NO_COLOR;
+  ctx->_last_bg = CONGE__NO_COLOR;
+
+  ctx->frame_bytes = 0;
+  ctx->frame_writes = 0;
+
+  ctx->input_time = 0.0;
+  ctx->tick_time = 0.0;
+  ctx->present_time = 0.0;
+  ctx->sleep_time = 0.0;
+
+  ctx->frame_time_p50 = 0.0;
+  ctx->frame_time_p95 = 0.0;
+  ctx->frame_time_p99 = 0.0;
+
+  ctx->_frame_time_count = 0;
+  ctx->_frame_time_next = 0;
 
-  ctx->_last_color = 0;
+  ctx->_stats_started = 0;
+  ctx->_trace = NULL;
+  ctx->_trace_capacity = 0;
+  ctx->_trace_count = 0;
+  ctx->_trace_next = 0;
 
+  ctx->_output_buffer = NULL;
+  ctx->_output_length = 0;
+  ctx->_output_capacity = 0;
+
+  ctx->_last_title[0] = '\0';
+
+  ctx->_buffers = NULL;
+  ctx->_buffers_size = 0;
+  ctx->_swap_count = 0;
+  ctx->_presenting = &ctx->_swaps[0];
+
+  /* Nothing has been presented yet, so there's nothing to measure. */
+  memset (ctx->_swaps, 0, sizeof (ctx->_swaps));
   ctx->_backbuffer = NULL;
+  ctx->_wide_backbuffer = NULL;
+  ctx->_dirty = NULL;
+  ctx->_stale = NULL;
+  ctx->_retained = 0;
+  ctx->_layers = NULL;
+  ctx->_viewport_count = 0;
+
+  ctx->_buffer_rows = 0;
+  ctx->_buffer_cols = 0;
+  ctx->_buffer_format = CONGE_FORMAT_NARROW;
+  ctx->_buffer_subpixels = CONGE_SUBPIXELS_NONE;
+  ctx->_sub_dirty = NULL;
 
   return ctx;
 }
 
+int
+conge_set_format (conge_ctx* ctx, int format)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (format != CONGE_FORMAT_NARROW && format != CONGE_FORMAT_WIDE)
+    return 2;
+
+  /* The console is set up for the format as it opens. */
+  if (ctx->_open)
+    return 3;
+
+  ctx->format = format;
+
+  /* The narrow format has no characters to pack subpixels into. */
+  if (format == CONGE_FORMAT_NARROW)
+    ctx->subpixels = CONGE_SUBPIXELS_NONE;
+
+  return 0;
+}
+
+void
+conge_close (conge_ctx* ctx)
+{
+  /* The threads must not touch a console that's been restored. */
+  conge_stop_input_thread (ctx);
+  conge_finish_presenting (ctx);
+
+  ctx->_backend->close (ctx);
+  ctx->_open = 0;
+}
+
 /* Shorthand expression. */
 #define FREE(var) if ((var) != NULL) { free (var); (var) = NULL; }
 
@@ -59,54 +172,414 @@ conge_free (conge_ctx* ctx)
 {
   if (ctx != NULL)
     {
-      FREE (ctx->frame);
-      FREE (ctx->_backbuffer);
+      /* Stepping through frames may have left the console open. */
+      if (ctx->_open)
+        conge_close (ctx);
+
+      conge_stop_presenter (ctx);
+      conge_free_headless (ctx);
+      conge_pool_free (ctx->_pool);
+      conge_free_layers (ctx);
+
+      FREE (ctx->_buffers);
+      FREE (ctx->_output_buffer);
+      FREE (ctx->_trace);
       FREE (ctx);
     }
 }
 
 #undef FREE
 
+/* The screen buffers start on cache lines, so that rows can be vectorized. */
+#define CONGE__BUFFER_ALIGN 64
+
+/* Round SIZE up to the buffer alignment. */
+#define CONGE__ALIGN(size) \
+  (((size) + CONGE__BUFFER_ALIGN - 1) & ~(size_t) (CONGE__BUFFER_ALIGN - 1))
+
 /*
- * Disable the display of the console cursor.
+ * Carve the swap chain, the backbuffer, the subframe and the row spans out
+ * of a single block, allocating it only when the screen has outgrown it.
  */
-void
-conge_disable_cursor (conge_ctx* ctx)
+int
+conge_alloc_buffers (conge_ctx* ctx)
 {
-  CONSOLE_CURSOR_INFO info;
+  int count = ctx->_swaps_wanted, wide = ctx->format == CONGE_FORMAT_WIDE, i;
+  int sub_rows = ctx->rows * conge_subpixels_down (ctx->subpixels);
+  int sub_cols = ctx->cols * conge_subpixels_across (ctx->subpixels);
+  size_t cell = wide ? sizeof (conge_wide_pixel) : sizeof (conge_pixel);
+  size_t pixels = CONGE__ALIGN ((size_t) ctx->rows * ctx->cols * cell);
+  size_t spans = (size_t) ctx->rows * sizeof (*ctx->_dirty);
+  size_t subframe = CONGE__ALIGN ((size_t) sub_rows * sub_cols
+                                  * sizeof (*ctx->subframe));
+  size_t size = (count + 1) * pixels + subframe + (count + 1) * spans
+    + sub_rows * sizeof (*ctx->_sub_dirty);
+  char* block;
+
+  if (size > ctx->_buffers_size)
+    {
+      /* The old contents are about to be thrown away anyway. */
+      free (ctx->_buffers);
+      ctx->_buffers = malloc (size + CONGE__BUFFER_ALIGN - 1);
 
-  info.dwSize = 100;
-  info.bVisible = FALSE;
+      if (ctx->_buffers == NULL)
+        {
+          ctx->_buffers_size = 0;
+          ctx->_swap_count = 0;
+          ctx->frame = NULL;
+          ctx->wide_frame = NULL;
+          ctx->subframe = NULL;
+          return 1;
+        }
+
+      ctx->_buffers_size = size;
+    }
+
+  block = (char*) CONGE__ALIGN ((size_t) ctx->_buffers);
+
+  /* Only the pointers of the format in use are set. */
+  for (i = 0; i < count; i++)
+    {
+      char* buffer = block + i * pixels;
 
-  SetConsoleCursorInfo (ctx->_output, &info);
+      ctx->_swaps[i].pixels = wide ? NULL : (conge_pixel*) buffer;
+      ctx->_swaps[i].wide = wide ? (conge_wide_pixel*) buffer : NULL;
+      ctx->_swaps[i].dirty = (conge_span*) (block + (count + 1) * pixels
+                                            + subframe + i * spans);
+    }
+
+  ctx->_swap_count = count;
+  ctx->_backbuffer = wide ? NULL : (conge_pixel*) (block + count * pixels);
+  ctx->_wide_backbuffer = wide ? (conge_wide_pixel*) (block + count * pixels)
+    : NULL;
+  ctx->_stale = (conge_span*) (block + (count + 1) * pixels + subframe
+                               + count * spans);
+  ctx->_buffer_format = ctx->format;
+
+  ctx->subframe = sub_rows > 0
+    ? (unsigned int*) (block + (count + 1) * pixels) : NULL;
+  ctx->_sub_dirty = (conge_span*) (block + (count + 1) * pixels + subframe
+                                   + (count + 1) * spans);
+  ctx->sub_rows = sub_rows;
+  ctx->sub_cols = sub_cols;
+  ctx->_buffer_subpixels = ctx->subpixels;
+
+  return 0;
 }
 
+#undef CONGE__ALIGN
+
 /*
- * Update the window size variables.
+ * Mark every row of SPANS as empty, or as full if FULL is set.
  */
 void
-conge_get_window_size (conge_ctx* ctx)
+conge_reset_spans (conge_ctx* ctx, conge_span* spans, int full)
 {
-  CONSOLE_SCREEN_BUFFER_INFO csbi;
-  GetConsoleScreenBufferInfo (ctx->_output, &csbi);
+  int y;
 
-  ctx->cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-  ctx->rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+  for (y = 0; y < ctx->rows; y++)
+    {
+      spans[y].min = full ? 0 : ctx->cols;
+      spans[y].max = full ? ctx->cols - 1 : -1;
+    }
 }
 
-/* Make sure to call malloc before realloc. */
-#define ALLOC(var, size) ((var) == NULL ? malloc (size) : realloc ((var), (size)))
+/*
+ * Clear COUNT pixels of SWAP from OFFSET on, whatever its format.
+ */
+void
+conge_clear_swap (conge_swap* swap, long offset, int count)
+{
+  unsigned int fg = CONGE_PALETTE (CONGE_WHITE);
+  unsigned int bg = CONGE_PALETTE (CONGE_BLACK);
+
+  if (swap->wide != NULL)
+    conge_fill_wide_pixels (&swap->wide[offset], count,
+                            conge_new_wide_pixel (' ', fg, bg));
+  else
+    conge_fill_pixels (&swap->pixels[offset], count,
+                       conge_new_pixel (' ', CONGE_WHITE, CONGE_BLACK));
+}
 
 int
-conge_run (conge_ctx* ctx, conge_tick tick, int max_fps)
+conge_prepare_frame (conge_ctx* ctx)
 {
-  struct timeb start, end; /* used for measuring delta */
+  conge_swap *swap, *previous;
+  int count = ctx->rows * ctx->cols, retain = conge_frame_retained (ctx);
+  int x, y, i;
+
+  /* Force a redraw when the window size changes. */
+  if (ctx->rows != ctx->_buffer_rows || ctx->cols != ctx->_buffer_cols
+      || ctx->_swap_count != ctx->_swaps_wanted
+      || ctx->_buffer_format != ctx->format || ctx->_swap_count == 0
+      || ctx->_buffer_subpixels != ctx->subpixels)
+    {
+      /* The presenter might still be reading the old buffers. */
+      conge_finish_presenting (ctx);
 
-  conge_pixel clear_pixel = conge_new_pixel (' ', CONGE_WHITE, CONGE_BLACK);
+      if (conge_alloc_buffers (ctx))
+        return 1;
 
-  int screen_area = 0; /* used to detect changes in resolution */
-  int buffer_size, prev_buffer_size = 0;
-  int i;
+      conge_disable_cursor (ctx); /* the cursor reactivates after a resize */
+
+      /* Fill with junk. */
+      if (ctx->_wide_backbuffer != NULL)
+        memset (ctx->_wide_backbuffer, 0,
+                count * sizeof (*ctx->_wide_backbuffer));
+      else
+        memset (ctx->_backbuffer, 0, count * sizeof (*ctx->_backbuffer));
+
+      ctx->_buffer_rows = ctx->rows;
+      ctx->_buffer_cols = ctx->cols;
+
+      /* The console might've moved the cursor while resizing. */
+      ctx->_cursor_x = -1;
+      ctx->_cursor_y = -1;
+
+      /* Clear the screen, and compare all of it. */
+      for (i = 0; i < ctx->_swap_count; i++)
+        {
+          conge_clear_swap (&ctx->_swaps[i], 0, count);
+          conge_reset_spans (ctx, ctx->_swaps[i].dirty, 0);
+          ctx->_swaps[i].cluttered = 0;
+        }
+
+      conge_reset_spans (ctx, ctx->_stale, 1);
+
+      /* Start with no subpixels. */
+      if (ctx->subframe != NULL)
+        conge_fill_colors (ctx->subframe, ctx->sub_rows * ctx->sub_cols,
+                           CONGE_CLEAR);
+
+      for (i = 0; i < ctx->sub_rows; i++)
+        {
+          ctx->_sub_dirty[i].min = ctx->sub_cols;
+          ctx->_sub_dirty[i].max = -1;
+        }
+
+      if (conge_fit_layers (ctx))
+        return 1;
+    }
+
+  previous = &ctx->_swaps[(ctx->_frames_submitted + ctx->_swap_count - 1)
+                          % ctx->_swap_count];
+  swap = conge_acquire_swap (ctx);
+
+  ctx->frame = swap->pixels;
+  ctx->wide_frame = swap->wide;
+  ctx->_dirty = swap->dirty;
+
+  /* Each tick starts drawing into the whole screen. */
+  ctx->_viewport_count = 0;
+
+  if (retain)
+    {
+      /* Carry on from the last tick, whichever buffer it drew into. */
+      if (swap != previous)
+        {
+          if (swap->wide != NULL)
+            memcpy (swap->wide, previous->wide, count * sizeof (*swap->wide));
+          else
+            memcpy (swap->pixels, previous->pixels,
+                    count * sizeof (*swap->pixels));
+
+          swap->cluttered = 1;
+        }
+
+      conge_reset_spans (ctx, swap->dirty, 0);
+    }
+  else if (ctx->_retained)
+    {
+      /* Retained frames pile up; start over from a clear screen. */
+      conge_clear_swap (swap, 0, count);
+      conge_reset_spans (ctx, swap->dirty, 1);
+      swap->cluttered = 0;
+    }
+  else if (swap->cluttered)
+    {
+      /* The screen is fine, but this buffer isn't. */
+      conge_clear_swap (swap, 0, count);
+      conge_reset_spans (ctx, swap->dirty, 0);
+      swap->cluttered = 0;
+    }
+  else
+    {
+      /* The rest of the buffer is clear already. */
+      for (y = 0; y < ctx->rows; y++)
+        {
+          x = swap->dirty[y].min;
+
+          if (x <= swap->dirty[y].max)
+            conge_clear_swap (swap, (long) ctx->cols * y + x,
+                              swap->dirty[y].max - x + 1);
+        }
+
+      conge_reset_spans (ctx, swap->dirty, 0);
+    }
+
+  conge_prepare_subframe (ctx);
+  ctx->_retained = retain;
+
+  return 0;
+}
+
+int
+conge_frame_retained (conge_ctx* ctx)
+{
+  return ctx->retain || ctx->_layers != NULL;
+}
+
+int
+conge_compare_doubles (const void* a, const void* b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * Add a delta time to the window, and update the FPS and percentiles.
+ */
+void
+conge_measure_frame (conge_ctx* ctx, double delta)
+{
+  double sorted[CONGE_FRAME_WINDOW], total = 0.0;
+  int i, count;
+
+  ctx->_frame_times[ctx->_frame_time_next] = delta;
+  ctx->_frame_time_next = (ctx->_frame_time_next + 1) % CONGE_FRAME_WINDOW;
+
+  if (ctx->_frame_time_count < CONGE_FRAME_WINDOW)
+    ctx->_frame_time_count++;
+
+  count = ctx->_frame_time_count;
+
+  for (i = 0; i < count; i++)
+    {
+      sorted[i] = ctx->_frame_times[i];
+      total += sorted[i];
+    }
+
+  ctx->fps = total > 0.0 ? count / total : 0.0;
+
+  qsort (sorted, count, sizeof (*sorted), conge_compare_doubles);
+
+  /* Nearest-rank percentiles. */
+  ctx->frame_time_p50 = sorted[(count * 50 + 99) / 100 - 1];
+  ctx->frame_time_p95 = sorted[(count * 95 + 99) / 100 - 1];
+  ctx->frame_time_p99 = sorted[(count * 99 + 99) / 100 - 1];
+}
+
+int
+conge_step (conge_ctx* ctx, conge_tick tick)
+{
+  double now, input_start, tick_start;
+
+  if (ctx == NULL)
+    return 1;
+
+  now = ctx->_backend->now (ctx);
+
+  CONGE__TRACE (conge_trace_frame (ctx));
+
+  if (!ctx->_open)
+    {
+      ctx->_backend->open (ctx);
+      ctx->_open = 1;
+      ctx->_deadline = now;
+
+      /* Fall back to reading input on this thread. */
+      if (ctx->_input_threaded && conge_start_input_thread (ctx))
+        ctx->_input_threaded = 0;
+    }
+  else
+    {
+      /* Update the counters and FPS. */
+      ctx->delta = now - ctx->_frame_start;
+      ctx->ticks++;
+      ctx->elapsed += ctx->delta;
+
+      conge_measure_frame (ctx, ctx->delta);
+    }
+
+  ctx->_frame_start = now;
+
+  /* The console window might've been resized last frame. */
+  CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_WINDOW_SIZE));
+  ctx->_backend->get_window_size (ctx);
+  CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_WINDOW_SIZE));
+
+  CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_PREPARE));
+
+  if (conge_prepare_frame (ctx))
+    {
+      conge_close (ctx);
+      return 3;
+    }
+
+  CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_PREPARE));
+
+  input_start = ctx->_backend->now (ctx);
+  CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_INPUT));
+  conge_handle_input (ctx);
+  CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_INPUT));
+
+  tick_start = ctx->_backend->now (ctx);
+  ctx->input_time = tick_start - input_start;
+
+  CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_TICK));
+  tick (ctx);
+  CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_TICK));
+
+  ctx->tick_time = ctx->_backend->now (ctx) - tick_start;
+
+  if (ctx->exit)
+    {
+      conge_close (ctx);
+      return 0;
+    }
+
+  conge_draw_frame (ctx);
+
+  return 0;
+}
+
+void
+conge_wait_for_frame (conge_ctx* ctx)
+{
+  double start = ctx->_backend->now (ctx), now = start;
+
+  CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_SLEEP));
+
+  /* Nothing changes until the next event, so don't draw until then. */
+  if (ctx->idle)
+    {
+      conge_wait_for_input (ctx, ctx->idle_timeout);
+      now = ctx->_backend->now (ctx);
+    }
+
+  /*
+   * Frames are due at fixed times, so that waking up late doesn't delay
+   * the following frames as well.
+   */
+  ctx->_deadline += ctx->timestep;
+
+  /* Don't rush through frames to make up for a stall. */
+  if (ctx->_deadline < now - ctx->timestep)
+    ctx->_deadline = now;
+
+  if (ctx->_deadline > now)
+    ctx->_backend->sleep (ctx, ctx->_deadline - now);
+
+  CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_SLEEP));
+
+  ctx->sleep_time = ctx->_backend->now (ctx) - start;
+}
+
+int
+conge_run (conge_ctx* ctx, conge_tick tick, int max_fps)
+{
+  int status;
 
   if (ctx == NULL)
     return 1;
@@ -116,67 +589,109 @@ conge_run (conge_ctx* ctx, conge_tick tick, int max_fps)
 
   ctx->timestep = 1.0 / max_fps;
 
-  /* Mouse support. */
-  DWORD mouse_flags = ENABLE_MOUSE_INPUT | ENABLE_EXTENDED_FLAGS;
-  SetConsoleMode (ctx->_input, mouse_flags);
-
   for (;;)
     {
-      ftime (&start);
+      status = conge_step (ctx, tick);
 
-      /* The console window might've been resized last frame. */
-      conge_get_window_size (ctx);
+      if (status != 0 || ctx->exit)
+        return status;
 
-      /* Calculate screen buffer size. */
-      screen_area = ctx->rows * ctx->cols;
-      buffer_size = screen_area * sizeof (*ctx->frame);
+      conge_wait_for_frame (ctx);
+    }
+}
 
-      /* Allocate the screen buffers. */
-      ctx->frame = ALLOC (ctx->frame, buffer_size);
-      ctx->_backbuffer = ALLOC (ctx->_backbuffer, buffer_size);
+/*
+ * The tick function of conge_run_fixed.
+ */
+void
+conge_fixed_tick (conge_ctx* ctx)
+{
+  int frame_keys[CONGE__KEYS_LENGTH];
+  double delta = ctx->delta;
+  int i, updates = 0;
 
-      /* Something went wrong in memory allocation. */
-      if (ctx->frame == NULL || ctx->_backbuffer == NULL)
-        return 3;
+  /* RENDER is told of the keys pressed since the previous frame. */
+  for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+    frame_keys[i] = ctx->_prev_keys[i];
 
-      /* Clear the screen. */
-      for (i = 0; i < screen_area; i++)
-        ctx->frame[i] = clear_pixel;
+  ctx->_accumulator += delta;
+  ctx->delta = ctx->_update_step;
 
-      /* Force a redraw when the window size changes. */
-      if (buffer_size != prev_buffer_size)
+  while (ctx->_accumulator >= ctx->_update_step && !ctx->exit)
+    {
+      if (updates == CONGE_MAX_UPDATES)
         {
-          conge_disable_cursor (ctx); /* the cursor reactivates after a resize */
-          memset (ctx->_backbuffer, 0, buffer_size); /* fill with junk */
-          prev_buffer_size = buffer_size;
+          /* Too far behind: let the simulation slow down instead. */
+          ctx->_accumulator = fmod (ctx->_accumulator, ctx->_update_step);
+          break;
         }
 
-      conge_handle_input (ctx);
-      tick (ctx);
+      /* "Just pressed" means since the previous update. */
+      for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+        ctx->_prev_keys[i] = ctx->_update_keys[i];
+
+      ctx->_update (ctx);
+
+      for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+        ctx->_update_keys[i] = ctx->_keys[i];
+
+      ctx->_accumulator -= ctx->_update_step;
+      updates++;
+    }
+
+  ctx->delta = delta;
 
-      if (ctx->exit)
-        return 0;
+  for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+    ctx->_prev_keys[i] = frame_keys[i];
 
-      SetConsoleTitle (ctx->title);
-      conge_draw_frame (ctx);
+  if (!ctx->exit)
+    ctx->_render (ctx, ctx->_accumulator / ctx->_update_step);
+}
 
-      ftime (&end);
+int
+conge_run_fixed (conge_ctx* ctx, conge_tick update, conge_render render,
+                 int update_rate, int max_fps)
+{
+  int status, i;
 
-      /* Measure the delta time in seconds. */
-      ctx->delta = (end.time - start.time) + 0.001 * (end.millitm - start.millitm);
+  if (ctx == NULL)
+    return 1;
+
+  if (update_rate < 1 || max_fps < 0)
+    return 2;
+
+  ctx->_update = update;
+  ctx->_render = render;
+  ctx->_update_step = 1.0 / update_rate;
+
+  /* Start with an update, so that the first frame has something to show. */
+  ctx->_accumulator = ctx->_update_step;
+
+  for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+    ctx->_update_keys[i] = ctx->_keys[i];
 
-      /* Sleep in order to prevent the game from running too quickly. */
-      if (ctx->delta < ctx->timestep)
+  if (max_fps > 0)
+    ctx->timestep = 1.0 / max_fps;
+
+  for (;;)
+    {
+      status = conge_step (ctx, conge_fixed_tick);
+
+      if (status != 0 || ctx->exit)
+        return status;
+
+      if (max_fps > 0)
+        conge_wait_for_frame (ctx);
+      else if (ctx->idle)
         {
-          Sleep (1000 * (ctx->timestep - ctx->delta));
-          ctx->delta = ctx->timestep;
-        }
+          double start = ctx->_backend->now (ctx);
 
-      /* Update the counters and FPS. */
-      ctx->ticks++;
-      ctx->elapsed += ctx->delta;
-      ctx->fps = ctx->ticks / ctx->elapsed;
+          /* Without a limit, there's still no point drawing while idle. */
+          CONGE__TRACE (conge_trace_begin (ctx, CONGE_PHASE_SLEEP));
+          conge_wait_for_input (ctx, ctx->idle_timeout);
+          CONGE__TRACE (conge_trace_end (ctx, CONGE_PHASE_SLEEP));
+
+          ctx->sleep_time = ctx->_backend->now (ctx) - start;
+        }
     }
 }
-
-#undef ALLOC
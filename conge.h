@@ -7,20 +7,35 @@
 
 #include <stdlib.h>
 #include <stdio.h> /* sprintf is useful for conge_write_string */
+#include <stdarg.h>
 #include <string.h>
-#include <io.h>
-#include <sys/timeb.h>
+#include <limits.h>
 
 /* Make sure the math constants are defined. */
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-#define _WIN32_WINNT 0x0500
+#ifdef _WIN32
+#include <io.h>
+
+/* Condition variables need Vista. */
+#define _WIN32_WINNT 0x0600
 #include <windows.h>
 
+/* Missing from older SDKs; Windows 10 consoles understand VT sequences. */
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
 /* Weird stuff from the evil header above. */
 #undef near
 #undef far
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <pthread.h>
+#endif
 
 #define CONGE_MIN(A, B) ((A) < (B) ? (A) : (B))
 #define CONGE_MAX(A, B) ((A) > (B) ? (A) : (B))
@@ -28,15 +43,272 @@
 /* An ASCII character and two 16-color variables can fit into two bytes. */
 typedef unsigned short int conge_pixel;
 
+/*
+ * A pixel of the wide format: any Unicode character, in any of the 256
+ * palette colors or 16 million true ones. See conge_set_format.
+ */
+typedef struct conge_wide_pixel conge_wide_pixel;
+struct conge_wide_pixel
+{
+  unsigned int character; /* a code point, which takes up a single column */
+  unsigned int fg, bg; /* CONGE_RGB or CONGE_PALETTE colors */
+};
+
+/* A true color, from 0 to 255 per channel. */
+#define CONGE_RGB(R, G, B) \
+  ((((R) & 0xFFu) << 16) | (((G) & 0xFFu) << 8) | ((B) & 0xFFu))
+
+/*
+ * A color of the terminal's 256-color palette. The first 16 are the
+ * CONGE_* color names, and so only these fit in a conge_pixel.
+ */
+#define CONGE_PALETTE(INDEX) (0x1000000u | ((INDEX) & 0xFFu))
+
+/* Internal: a wide color no console shows, for when it's unknown. */
+#define CONGE__NO_COLOR 0xFFFFFFFFu
+
+/* A subpixel color: nothing is drawn there. See conge_set_subpixels. */
+#define CONGE_CLEAR 0xFFFFFFFFu
+
+/* Pixel formats; see conge_set_format. */
+enum
+  {
+    CONGE_FORMAT_NARROW, /* conge_pixel */
+    CONGE_FORMAT_WIDE, /* conge_wide_pixel */
+  };
+
+/* Subpixel modes; see conge_set_subpixels. */
+enum
+  {
+    CONGE_SUBPIXELS_NONE,
+    CONGE_SUBPIXELS_HALF_BLOCK, /* 1x2 per cell, in two colors */
+    CONGE_SUBPIXELS_BRAILLE, /* 2x4 per cell, in one color */
+  };
+
+/* Internal: a range of columns in a row. Empty when min > max. */
+typedef struct conge_span conge_span;
+struct conge_span
+{
+  int min, max;
+};
+
+/*
+ * Internal: a clip rectangle of the screen, and where the origin of the
+ * drawing functions is on it.
+ */
+typedef struct conge_viewport conge_viewport;
+struct conge_viewport
+{
+  int x, y; /* the origin */
+  int clip_x0, clip_y0, clip_x1, clip_y1; /* the only pixels to touch */
+};
+
+/* Internal: a fill for the rasterizers, in the format of any target. */
+typedef struct conge_cell conge_cell;
+struct conge_cell
+{
+  conge_pixel pixel;
+  conge_wide_pixel wide;
+  unsigned int color; /* for subpixels */
+};
+
+/* Internal: pixels the rasterizers draw into. */
+typedef struct conge_target conge_target;
+struct conge_target
+{
+  conge_pixel* pixels; /* row by row, unless the target is wide */
+  conge_wide_pixel* wide; /* or these if it is */
+  unsigned int* colors; /* or these, if it's the subframe */
+  int stride; /* the distance between rows, in pixels */
+  int clip_x0, clip_y0, clip_x1, clip_y1; /* the only pixels to touch */
+  conge_span* dirty; /* per row: extended to cover the drawn pixels */
+};
+
+/* Internal: threads and their synchronization, whatever the platform. */
+#ifdef _WIN32
+typedef HANDLE conge_thread;
+typedef CRITICAL_SECTION conge_mutex;
+typedef CONDITION_VARIABLE conge_cond;
+#else
+typedef pthread_t conge_thread;
+typedef pthread_mutex_t conge_mutex;
+typedef pthread_cond_t conge_cond;
+#endif
+
+/* Internal: worker threads sharing jobs with the calling thread. */
+typedef struct conge_pool conge_pool;
+
+/* Recorded drawing commands; see conge_cmdbuf_new. */
+typedef struct conge_cmdbuf conge_cmdbuf;
+
+/* A block of pixels to blit onto frames; see conge_sprite_new. */
+typedef struct conge_sprite conge_sprite;
+struct conge_sprite
+{
+  conge_pixel* pixels; /* row by row; free to change */
+  int w, h; /* the size in pixels */
+  conge_pixel key; /* pixels equal to it are transparent; 0 unless set */
+};
+
+/* Flags for conge_blit. */
+enum
+  {
+    CONGE_FLIP_X = 1, /* mirror the sprite left to right */
+    CONGE_FLIP_Y = 2, /* and top to bottom */
+    CONGE_OPAQUE = 4, /* copy key pixels like the others */
+  };
+
+/* Flags for conge_draw_text. */
+enum
+  {
+    CONGE_ALIGN_CENTER = 1, /* center each line within the width */
+    CONGE_ALIGN_RIGHT = 2, /* or align it to the right */
+    CONGE_WRAP = 4, /* break lines longer than the width between words */
+    CONGE_MARKUP = 8, /* take the ^ sequences as colors */
+  };
+
+/* A buffer of pixels composited into the frame; see conge_layer_new. */
+typedef struct conge_layer conge_layer;
+
+/* Pixels to draw into off the screen; see conge_canvas_new. */
+typedef struct conge_canvas conge_canvas;
+struct conge_canvas
+{
+  conge_pixel* pixels; /* row by row, unless the canvas is wide */
+  conge_wide_pixel* wide; /* or these if it is */
+  int w, h; /* the size in pixels */
+  int stride; /* the distance between rows, in pixels */
+  int clip_x0, clip_y0, clip_x1, clip_y1; /* the only pixels drawn into */
+  conge_pixel key; /* narrow pixels equal to it aren't blitted; 0 unless set */
+};
+
+/* Internal: hands input from the input thread to the main one. */
+typedef struct conge_input_queue conge_input_queue;
+
+/* Internal: the thread presenting frames the main one has drawn. */
+typedef struct conge_presenter conge_presenter;
+
+/* Internal: the headless backend's state. */
+typedef struct conge_headless conge_headless;
+
+/* Internal: the console the engine draws to, and reads input from. */
+typedef struct conge_backend conge_backend;
+
+/* Define CONGE_NO_TRACE to compile out frame tracing; see conge_trace_start. */
+#ifdef CONGE_NO_TRACE
+#define CONGE__TRACE(statement)
+#else
+#define CONGE__TRACE(statement) statement
+#endif
+
+/* The parts of a frame, as traced. */
+enum
+  {
+    CONGE_PHASE_WINDOW_SIZE, /* querying the window size */
+    CONGE_PHASE_PREPARE, /* resizing or clearing the buffers */
+    CONGE_PHASE_INPUT, /* handling input */
+    CONGE_PHASE_TICK, /* the tick function */
+    CONGE_PHASE_TITLE, /* updating the window title */
+    CONGE_PHASE_DIFF, /* comparing and encoding the changed pixels */
+    CONGE_PHASE_FLUSH, /* writing the output to the console */
+    CONGE_PHASE_SLEEP, /* waiting for the next frame */
+    CONGE_PHASE_COUNT,
+  };
+
+/* A frame's measurements, as traced. */
+typedef struct conge_frame_stats conge_frame_stats;
+struct conge_frame_stats
+{
+  unsigned int frame; /* the tick count */
+  double start; /* the frame's start in seconds, on a monotonic clock */
+  double phase_start[CONGE_PHASE_COUNT]; /* when each phase started */
+  double phase_time[CONGE_PHASE_COUNT]; /* how long it took, or 0 */
+  unsigned int cells_diffed; /* pixels compared to the previous frame */
+  unsigned int cells_emitted; /* changed pixels sent to the console */
+  unsigned int cursor_moves; /* cursor movements sent */
+  unsigned int color_changes; /* color changes sent */
+  unsigned int bytes; /* bytes written */
+  unsigned int writes; /* output syscalls issued */
+  int pipelined; /* set if an earlier frame was presented on another thread */
+};
+
+/* The most frame buffers conge_set_swap_chain can ask for. */
+#define CONGE_MAX_SWAPS 3
+
+/* Internal: a frame buffer of the swap chain, and what came with its tick. */
+typedef struct conge_swap conge_swap;
+struct conge_swap
+{
+  conge_pixel* pixels; /* the frame, row by row */
+  conge_wide_pixel* wide; /* or that, in the wide format */
+  conge_span* dirty; /* per row: the pixels drawn during its tick */
+  int cluttered; /* set if a retained frame left more than DIRTY in it */
+  int retain; /* CTX->retain as of its tick */
+  int traced; /* set if its presentation is to be timed */
+  char title[128]; /* CTX->title as of its tick */
+  conge_frame_stats stats; /* the phases and counters of its presentation */
+  double present_time; /* how long it took */
+};
+
+/* Input event types. */
+enum
+  {
+    CONGE_EVENT_KEY_DOWN,
+    CONGE_EVENT_KEY_UP,
+    CONGE_EVENT_MOUSE_MOVE,
+    CONGE_EVENT_BUTTON_DOWN,
+    CONGE_EVENT_BUTTON_UP,
+    CONGE_EVENT_SCROLL,
+    CONGE_EVENT_CHARACTER,
+  };
+
+/* A single input event. */
+typedef struct conge_event conge_event;
+struct conge_event
+{
+  int type; /* one of CONGE_EVENT_* */
+  int code; /* the scancode for keys, or CONGE_LMB/CONGE_RMB for buttons */
+  int x, y; /* the mouse position for mouse events */
+  int scroll; /* forward if 1, backward if -1 */
+  int character; /* the ASCII character typed, for character events */
+  double time; /* when it was read, in the same seconds as CTX->elapsed */
+};
+
+/* The most input events a single frame keeps; older ones are dropped. */
+#define CONGE_MAX_EVENTS 256
+
+/* The most viewports which can be pushed at once. */
+#define CONGE_MAX_VIEWPORTS 32
+
+/* The amount of frames ctx->fps and the frame time percentiles cover. */
+#define CONGE_FRAME_WINDOW 120
+
 /* Internal constant. 256 scancodes divided by sizeof (int) in bits. */
 #define CONGE__KEYS_LENGTH (32 / sizeof (int))
 
 /* The ConGE context, which is required to run the engine. */
 typedef struct conge_ctx conge_ctx;
+
+/* The function called before rendering each frame. */
+typedef void (*conge_tick) (conge_ctx* ctx);
+
+/*
+ * The function drawing each frame in conge_run_fixed. ALPHA is how far the
+ * frame is between the last update and the next one, from 0 to 1.
+ */
+typedef void (*conge_render) (conge_ctx* ctx, double alpha);
+
+/* The most updates conge_run_fixed catches up with in a single frame. */
+#define CONGE_MAX_UPDATES 8
 struct conge_ctx
 {
   /* Public API. Read-only unless specified otherwise. */
-  conge_pixel* frame; /* output: the frame being rendered */
+  conge_pixel* frame; /* output: the frame being rendered, row by row */
+  conge_wide_pixel* wide_frame; /* output: the same in the wide format */
+  int format; /* CONGE_FORMAT_WIDE if WIDE_FRAME is used instead of FRAME */
+  unsigned int* subframe; /* output: the subpixel colors, row by row */
+  int subpixels; /* the CONGE_SUBPIXELS_* mode SUBFRAME is in */
+  int sub_rows, sub_cols; /* the subframe size in subpixels */
   int rows, cols; /* window size in characters */
   double delta; /* previous frame's delta time */
   double elapsed; /* seconds since the engine was started */
@@ -46,37 +318,194 @@ struct conge_ctx
   int mouse_dx, mouse_dy; /* mouse position relative to the previous frame */
   int grab; /* output: set this to grab/ungrab the mouse */
   int exit; /* output: when set to true, the program will exit */
-  double fps; /* the current FPS */
+  int retain; /* output: set to keep the last frame instead of clearing it */
+  int idle; /* output: set if nothing changes until input, to wait for it */
+  double idle_timeout; /* output: the longest wait while idle, unless 0 */
+  double fps; /* the FPS over the last CONGE_FRAME_WINDOW frames */
   unsigned int ticks; /* the total amount of ticks done */
   char title[128]; /* output: the console window title */
+  unsigned int frame_bytes; /* bytes written to the console last frame */
+  unsigned int frame_writes; /* output syscalls issued last frame */
+  double input_time; /* seconds spent handling input this frame */
+  double tick_time; /* seconds spent in the tick function last frame */
+  double present_time; /* seconds spent presenting the last frame */
+  double sleep_time; /* seconds spent waiting for this frame */
+  double frame_time_p50; /* the median delta time over the FPS window */
+  double frame_time_p95; /* its 95th percentile */
+  double frame_time_p99; /* its 99th percentile */
   /* Internal API; avoid at all cost! */
+  const conge_backend* _backend; /* the console in use */
+  conge_headless* _headless; /* set if it's just memory */
+  int _open; /* set if the backend is prepared for drawing */
+  conge_pool* _pool; /* rasterizes command buffers, unless null */
+  int _input_threaded; /* set if a thread should read input while open */
+  conge_input_queue* _input_queue; /* set while one does */
+  conge_presenter* _presenter; /* presents frames on a thread, unless null */
+  int _swaps_wanted; /* the swap chain length, as of the next tick */
+  volatile long _frames_submitted; /* frames handed over for presenting */
+  volatile long _frames_presented; /* and those presented so far */
+  double _frame_start; /* when the current frame started */
+  double _deadline; /* when the current frame was due to start */
+  conge_tick _update; /* conge_run_fixed's callbacks */
+  conge_render _render;
+  double _update_step; /* seconds between updates */
+  double _accumulator; /* seconds left to simulate */
+  int _update_keys[CONGE__KEYS_LENGTH]; /* the keys at the last update */
+  conge_frame_stats _stats; /* the current frame's measurements */
+  int _stats_started; /* set if _stats covers the frame from its start */
+  conge_frame_stats* _trace; /* a ring of the latest frames, if tracing */
+  int _trace_capacity, _trace_count, _trace_next;
+  double _frame_times[CONGE_FRAME_WINDOW]; /* the latest delta times */
+  int _frame_time_count, _frame_time_next;
+#ifdef _WIN32
   HANDLE _input, _output; /* console IO handles */
   HWND _window; /* console window handle */
-  conge_pixel* _backbuffer; /* double-buffering support */
+  DWORD _record_buttons; /* the buttons as of the last mouse record */
+  UINT _code_page; /* the output code page to restore, if changed */
+  int _modes_saved; /* set if the modes below must be restored on exit */
+  DWORD _input_mode, _output_mode; /* the console modes before opening */
+#else
+  int _input, _output; /* terminal file descriptors */
+  int _raw; /* set if _termios must be restored on exit */
+  struct termios _termios; /* the terminal settings before going raw */
+  int _resize_hooked; /* set if _resize_action must be restored on exit */
+  struct sigaction _resize_action; /* the SIGWINCH action before opening */
+  char _input_buffer[64]; /* an escape sequence cut off by the last read */
+  int _input_length;
+  int _input_closed; /* set once the terminal hangs up */
+  double _key_expiry[256]; /* terminals don't report key releases */
+#endif
+  void* _buffers; /* the block the buffers below and the frame are in */
+  size_t _buffers_size; /* its usable size in bytes */
+  conge_swap _swaps[CONGE_MAX_SWAPS]; /* the frames, in turn */
+  int _swap_count; /* the ones in use */
+  conge_swap* _presenting; /* the frame being presented, or the last one */
+  conge_pixel* _backbuffer; /* what the console shows */
+  conge_wide_pixel* _wide_backbuffer; /* the same, in the wide format */
+  conge_span* _dirty; /* per row: the pixels drawn during this tick */
+  conge_span* _stale; /* per row: the pixels drawn in the last frame shown */
+  int _buffer_rows, _buffer_cols; /* the size the buffers were made for */
+  int _buffer_format; /* and their format */
+  int _buffer_subpixels; /* and subpixel mode */
+  conge_span* _sub_dirty; /* per subpixel row: the subpixels drawn */
+  int _retained; /* set if the last tick's frame was retained */
+  conge_layer* _layers; /* the layer stack, from the bottom, or null */
+  conge_viewport _viewports[CONGE_MAX_VIEWPORTS]; /* the innermost last */
+  int _viewport_count;
   int _keys[CONGE__KEYS_LENGTH]; /* a 256-bit bitflag */
   int _prev_keys[CONGE__KEYS_LENGTH]; /* handle "just pressed" events */
+  conge_event _events[CONGE_MAX_EVENTS]; /* a ring of the frame's input */
+  int _event_first, _event_count;
   int _buttons; /* the currently held mouse buttons */
   int _cursor_x, _cursor_y; /* prevent unnecessary cursor movements */
   int _last_color; /* same for changing the color */
+  unsigned int _last_fg, _last_bg; /* and in the wide format */
+  char* _output_buffer; /* the frame's escape sequences, written at once */
+  int _output_length, _output_capacity;
+  char _last_title[128]; /* the title currently shown by the console */
 };
 
-/* The function called before rendering each frame. */
-typedef void (*conge_tick) (conge_ctx* ctx);
+
+struct conge_backend
+{
+  void (*open) (conge_ctx*); /* prepare the console for drawing */
+  void (*close) (conge_ctx*); /* restore its previous state */
+  void (*get_window_size) (conge_ctx*); /* update rows and cols */
+  void (*handle_input) (conge_ctx*); /* take the frame's input */
+  int (*read_input) (conge_ctx*); /* to conge_read_event; 0 if none came */
+  int (*write) (conge_ctx*, const char*, int); /* return bytes written */
+  double (*now) (conge_ctx*); /* monotonic time in seconds */
+  void (*sleep) (conge_ctx*, double seconds); /* as precisely as it can */
+  void (*wait) (conge_ctx*, double seconds); /* for input, at most SECONDS */
+};
 
 /* TODO: add mouse wheel click. */
+#ifdef _WIN32
 #define CONGE_LMB FROM_LEFT_1ST_BUTTON_PRESSED
 #define CONGE_RMB RIGHTMOST_BUTTON_PRESSED
+#else
+#define CONGE_LMB 0x1
+#define CONGE_RMB 0x2
+#endif
 
 /*
  * Initialize a new ConGE context. Return NULL if memory allocation failed.
  */
 conge_ctx* conge_init ();
 
+/*
+ * Initialize a ConGE context which draws into memory instead of the console.
+ *
+ * The screen is COLS by ROWS characters. Input only comes from events
+ * queued with conge_headless_push_event, and time only passes while
+ * conge_run waits for the next frame, so frames are never actually
+ * delayed and the output is deterministic.
+ *
+ * Return NULL if memory allocation failed, or the size isn't positive.
+ */
+conge_ctx* conge_init_headless (int cols, int rows);
+
+/*
+ * Draw frames in FORMAT, one of CONGE_FORMAT_*, which must be chosen before
+ * the first frame. CONGE_FORMAT_NARROW, the default, keeps each pixel in a
+ * conge_pixel in CTX->frame. CONGE_FORMAT_WIDE keeps a conge_wide_pixel in
+ * CTX->wide_frame instead, and sends the console UTF-8 and 256-color or
+ * true color sequences, so the console has to understand these.
+ *
+ * The drawing functions work in either format: the wide ones, such as
+ * conge_fill_wide, narrow their colors down to the nearest of the 16 in the
+ * narrow format, while the others use the first 16 palette colors in the
+ * wide one.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - unknown FORMAT.
+ *   3 - the console is already open.
+ */
+int conge_set_format (conge_ctx*, int format);
+
+/*
+ * Draw subpixels over the frame in MODE, one of CONGE_SUBPIXELS_*, from the
+ * next frame on. Each cell of the frame gets several pixels in
+ * CTX->subframe, which the subpixel drawing functions draw into, at twice
+ * the resolution of the frame or more:
+ *
+ * CONGE_SUBPIXELS_HALF_BLOCK splits each cell into a top and a bottom half,
+ * and shows them with half block characters in their own colors.
+ *
+ * CONGE_SUBPIXELS_BRAILLE splits each cell into 2x4 dots of a braille
+ * character. A cell only has one foreground color, so its dots take the
+ * color of the first one drawn, in reading order.
+ *
+ * Subpixels are CONGE_CLEAR unless drawn, and the frame shows through
+ * them: a cell with no subpixels is left alone, and clear ones take the
+ * cell's background color. The subframe is cleared between frames like
+ * the frame, unless CTX->retain is set. Cells are only repacked where
+ * subpixels are drawn, so in retained frames, they cover whatever the cell
+ * showed before.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - unknown MODE.
+ *   3 - the format isn't CONGE_FORMAT_WIDE, which subpixels need.
+ */
+int conge_set_subpixels (conge_ctx*, int mode);
+
 /*
  * Run the ConGE mainloop.
  *
  * TICK must be a function which takes CTX as its only argument. It will be
- * called at most MAX_FPS times per second.
+ * called at most MAX_FPS times per second. Frames are scheduled at fixed
+ * intervals from the first one, so the rate doesn't drift.
+ *
+ * While TICK leaves CTX->idle set, the loop waits for input after each
+ * frame instead of running the next one: for a keypress, a mouse event or
+ * a resize, or until CTX->idle_timeout seconds pass if that's positive.
+ * Frames still come at most MAX_FPS times per second, and at full rate
+ * again once TICK clears CTX->idle. A headless context has no input to
+ * wait for, so its clock just skips ahead by the timeout, or by a frame.
  *
  * Return codes:
  *   0 - TICK requested exit (by setting CTX->exit to true).
@@ -86,6 +515,91 @@ conge_ctx* conge_init ();
  */
 int conge_run (conge_ctx* ctx, conge_tick tick, int max_fps);
 
+/*
+ * Run the ConGE mainloop, simulating at a fixed rate apart from rendering.
+ *
+ * UPDATE is called UPDATE_RATE times per second of elapsed time, with
+ * CTX->delta set to 1 / UPDATE_RATE. When frames take too long, the next
+ * one makes up for it with several updates, but at most CONGE_MAX_UPDATES;
+ * the rest of the backlog is dropped. Keys count as just pressed in the
+ * first update after they were.
+ *
+ * RENDER then draws the frame, at most MAX_FPS times per second, or as
+ * often as possible if MAX_FPS is zero. To RENDER, keys count as just
+ * pressed in the first frame after they were, as with conge_run, whether
+ * or not that frame ran any updates. CTX->idle waits for input after the
+ * frame either way. The headless clock only advances while waiting for
+ * frames, so it needs a limit or CTX->idle.
+ *
+ * Return codes:
+ *   0 - UPDATE or RENDER requested exit (by setting CTX->exit to true).
+ *   1 - CTX is null.
+ *   2 - UPDATE_RATE is negative or zero, or MAX_FPS is negative.
+ *   3 - failed to allocate one of the screen buffers.
+ */
+int conge_run_fixed (conge_ctx* ctx, conge_tick update, conge_render render,
+                     int update_rate, int max_fps);
+
+/*
+ * Run a single frame of the mainloop, without waiting for the next one.
+ *
+ * This handles input, calls TICK and draws the frame. Check CTX->exit
+ * afterwards to see if TICK requested exit.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   3 - failed to allocate one of the screen buffers.
+ */
+int conge_step (conge_ctx* ctx, conge_tick tick);
+
+/*
+ * Queue an input event for the next frame of a headless context.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null or not headless.
+ *   2 - EVENT is null.
+ *   3 - the queue is full.
+ */
+int conge_headless_push_event (conge_ctx*, const conge_event* event);
+
+/*
+ * Change the screen size of a headless context, starting next frame.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null or not headless.
+ *   2 - the size isn't positive.
+ *   3 - memory allocation failed.
+ */
+int conge_headless_resize (conge_ctx*, int cols, int rows);
+
+/*
+ * Return the bytes a headless context wrote since the last call, and store
+ * their amount in LENGTH. They stay valid until the next frame.
+ *
+ * Return NULL if CTX is null or not headless.
+ */
+const char* conge_headless_read_output (conge_ctx*, int* length);
+
+/*
+ * Return what the screen of a headless context shows at (X; Y), as
+ * understood from the escape sequences written to it.
+ *
+ * Return 0 if CTX is null or not headless, or the position is out of bounds.
+ */
+conge_pixel conge_headless_get_cell (conge_ctx*, int x, int y);
+
+/*
+ * Return the same as conge_headless_get_cell, in the wide format, which
+ * has all of the characters and colors the screen got.
+ *
+ * Return a zeroed pixel if CTX is null or not headless, or the position is
+ * out of bounds.
+ */
+conge_wide_pixel conge_headless_get_wide_cell (conge_ctx*, int x, int y);
+
 /*
  * Free the allocated ConGE context.
  */
@@ -105,6 +619,23 @@ void conge_set_fg (conge_pixel*, int);
 int conge_get_bg (conge_pixel);
 void conge_set_bg (conge_pixel*, int);
 
+/*
+ * Create a new wide pixel from a code point and its bg and fg colors.
+ */
+conge_wide_pixel conge_new_wide_pixel (unsigned int, unsigned int fg,
+                                       unsigned int bg);
+
+/*
+ * Convert a pixel to the wide format.
+ */
+conge_wide_pixel conge_widen_pixel (conge_pixel);
+
+/*
+ * Convert a wide pixel to the nearest narrow one. Characters beyond a byte
+ * become '?', and colors the nearest of the first 16 palette colors.
+ */
+conge_pixel conge_narrow_pixel (conge_wide_pixel);
+
 /*
  * Return the pixel at specified position from the current frame.
  *
@@ -116,6 +647,23 @@ void conge_set_bg (conge_pixel*, int);
  */
 conge_pixel* conge_get_pixel (conge_ctx*, int x, int y);
 
+/*
+ * Return the pixel at specified position from the current frame, in the
+ * wide format.
+ *
+ * Return null if X or Y are out of screen bounds, CTX is null or the frame
+ * isn't wide.
+ */
+conge_wide_pixel* conge_get_wide_pixel (conge_ctx*, int x, int y);
+
+/*
+ * Make sure the whole frame is compared with the screen when drawing it.
+ *
+ * Only pixels touched by the API are normally compared, so call this after
+ * writing to CTX->frame directly.
+ */
+void conge_invalidate (conge_ctx*);
+
 /*
  * Return 1 if the given key, identified by its scancode, is held down.
  *
@@ -130,6 +678,50 @@ int conge_is_key_down (conge_ctx*, int code);
  */
 int conge_is_key_just_pressed (conge_ctx*, int code);
 
+/*
+ * Take the oldest of the frame's input events which hasn't been taken yet,
+ * and store it in EVENT. Events are kept in the order they were read until
+ * the next frame, which starts over with its own; the key, button and mouse
+ * state already reflects all of them.
+ *
+ * Return 1 if there was one, or 0 if there wasn't or CTX or EVENT is null.
+ */
+int conge_next_event (conge_ctx*, conge_event* event);
+
+/*
+ * Read input on a thread of its own if ENABLE is set, or on the main one,
+ * which is the default, otherwise. The thread timestamps events as they
+ * arrive rather than when the frame gets to them, and hands them over
+ * without locking. Key, button and mouse state still only changes at the
+ * start of a frame.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - CTX is headless; its input only comes between frames anyway.
+ *   3 - the thread couldn't be started; input stays on the main thread.
+ */
+int conge_set_input_thread (conge_ctx*, int enable);
+
+/*
+ * Present frames from a swap chain of BUFFERS frame buffers, from 1 to
+ * CONGE_MAX_SWAPS. With a single one, the default, each frame is presented
+ * as soon as the tick is done with it. With more, a thread of their own
+ * presents them, while the next tick draws into the following buffer; the
+ * buffers change hands without copying or locking, and a tick only waits
+ * if it gets BUFFERS - 1 frames ahead of the console. Frames are presented
+ * just the same either way, but the timings and counters of the last frame
+ * presented belong to an earlier tick. The new buffers replace the current
+ * ones at the next tick.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - BUFFERS is out of range.
+ *   3 - the thread couldn't be started; frames stay on the main thread.
+ */
+int conge_set_swap_chain (conge_ctx*, int buffers);
+
 /*
  * Return 1 if the given mouse button (CONGE_LMB or CONGE_RMB) is down.
  *
@@ -150,6 +742,9 @@ int conge_fill (conge_ctx*, int x, int y, conge_pixel);
 /*
  * Draw a line between two points, filled with the specified pixel.
  *
+ * Both ends are included. The parts outside the screen are skipped without
+ * being visited.
+ *
  * Return codes:
  *   0 - success.
  *   1 - CTX is null.
@@ -159,7 +754,9 @@ int conge_draw_line (conge_ctx*, int x0, int y0, int x1, int y1, conge_pixel);
 /*
  * Fill a triangle, defined by the three of its vertices.
  *
- * The vertices must come in counter-clockwise order.
+ * The vertices must come in counter-clockwise order; clockwise triangles
+ * aren't drawn. Pixels on an edge shared by two triangles are filled by
+ * exactly one of them.
  *
  * Return codes:
  *   0 - success.
@@ -167,6 +764,16 @@ int conge_draw_line (conge_ctx*, int x0, int y0, int x1, int y1, conge_pixel);
  */
 int conge_fill_triangle (conge_ctx*, int, int, int, int,
                          int, int, conge_pixel);
+
+/*
+ * Fill the W by H rectangle whose top-left corner is at (X; Y).
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ */
+int conge_fill_rect (conge_ctx*, int x, int y, int w, int h, conge_pixel);
+
 /*
  * Write a string with specified position and color onto the frame.
  *
@@ -180,14 +787,913 @@ int conge_fill_triangle (conge_ctx*, int, int, int, int,
 int conge_write_string (conge_ctx*, const char*, int, int, int fg, int bg);
 
 /*
- * Internal: draw the current frame.
+ * The same as the functions above, with wide pixels and colors. The string
+ * is in UTF-8, and each code point takes up a column.
  */
-void conge_draw_frame (conge_ctx*);
+int conge_fill_wide (conge_ctx*, int x, int y, conge_wide_pixel);
+int conge_draw_line_wide (conge_ctx*, int x0, int y0, int x1, int y1,
+                          conge_wide_pixel);
+int conge_fill_triangle_wide (conge_ctx*, int, int, int, int, int, int,
+                              conge_wide_pixel);
+int conge_fill_rect_wide (conge_ctx*, int x, int y, int w, int h,
+                          conge_wide_pixel);
+int conge_write_string_wide (conge_ctx*, const char*, int, int,
+                             unsigned int fg, unsigned int bg);
 
 /*
- * Internal: handle input for the frame.
+ * The same as the functions above, drawing COLOR into the subframe, at
+ * subpixel coordinates. See conge_set_subpixels.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - subpixels are off.
  */
-void conge_handle_input (conge_ctx*);
+int conge_fill_subpixel (conge_ctx*, int x, int y, unsigned int color);
+int conge_draw_subpixel_line (conge_ctx*, int x0, int y0, int x1, int y1,
+                              unsigned int color);
+int conge_fill_subpixel_triangle (conge_ctx*, int, int, int, int, int, int,
+                                  unsigned int color);
+int conge_fill_subpixel_rect (conge_ctx*, int x, int y, int w, int h,
+                              unsigned int color);
+
+/*
+ * Write STRING onto the frame like conge_write_string, a line per row from
+ * (X; Y) down, with the lines separated by newlines. Each run of
+ * characters in the same colors is written at once, and the rows below the
+ * screen aren't looked at.
+ *
+ * FLAGS can include CONGE_ALIGN_CENTER or CONGE_ALIGN_RIGHT, to align each
+ * line within the W columns from X, and CONGE_WRAP, to break the lines
+ * longer than W at their last space, or within a word longer than that.
+ * W isn't used otherwise.
+ *
+ * With CONGE_MARKUP, these sequences change the colors from then on and
+ * take up no columns:
+ *   ^fX - the foreground: X is a hex digit, 0 to F, as the CONGE_* colors.
+ *   ^bX - the background, the same way.
+ *   ^r  - back to FG and BG.
+ *   ^^  - a ^ itself.
+ * A ^ followed by anything else is written as it is.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - STRING is null.
+ *   3 - W isn't positive, though the lines are aligned or wrapped.
+ */
+int conge_draw_text (conge_ctx*, const char* string, int x, int y, int w,
+                     int flags, int fg, int bg);
+
+/*
+ * Write FORMAT onto the frame from (X; Y) as printf would, formatting each
+ * conversion straight into the pixels instead of a buffer. Newlines start
+ * the next row at X.
+ *
+ * The conversions are %d, %i, %u, %x, %X, %f, %c, %s and %%, with the
+ * flags -, 0, + and space, a width and a precision, either of them *, and
+ * the l and ll lengths. %f rounds exactly to as many digits as fit in 53
+ * bits, about 16, and to 22 decimals at most; the decimals past them are
+ * written as zeros.
+ *
+ * Any other conversion is written as it is, and nothing after it is, as
+ * its argument can't be skipped.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - FORMAT is null.
+ *   3 - FORMAT has a conversion other than these.
+ */
+int conge_printf (conge_ctx*, int x, int y, int fg, int bg,
+                  const char* format, ...);
+int conge_vprintf (conge_ctx*, int x, int y, int fg, int bg,
+                   const char* format, va_list args);
+
+/*
+ * Create an empty command buffer.
+ *
+ * Drawing commands recorded into it take effect when it's submitted, and
+ * it can be submitted again on later frames as long as the scene stays the
+ * same. Return null if out of memory.
+ */
+conge_cmdbuf* conge_cmdbuf_new (void);
+
+/*
+ * Free the command buffer. Does nothing if CMDBUF is null.
+ */
+void conge_cmdbuf_free (conge_cmdbuf* cmdbuf);
+
+/*
+ * Forget the recorded commands, keeping the memory for new ones.
+ */
+void conge_cmdbuf_clear (conge_cmdbuf* cmdbuf);
+
+/*
+ * Record a call to conge_fill, conge_draw_line, conge_fill_triangle,
+ * conge_fill_rect or conge_write_string. The string is copied.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CMDBUF is null.
+ *   2 - STRING is null.
+ *   3 - out of memory.
+ */
+int conge_cmdbuf_fill (conge_cmdbuf*, int x, int y, conge_pixel);
+int conge_cmdbuf_line (conge_cmdbuf*, int x0, int y0, int x1, int y1,
+                       conge_pixel);
+int conge_cmdbuf_triangle (conge_cmdbuf*, int x0, int y0, int x1, int y1,
+                           int x2, int y2, conge_pixel);
+int conge_cmdbuf_rect (conge_cmdbuf*, int x, int y, int w, int h,
+                       conge_pixel);
+int conge_cmdbuf_string (conge_cmdbuf*, const char* string, int x, int y,
+                         int fg, int bg);
+
+/*
+ * Draw the recorded commands onto the frame.
+ *
+ * The frame ends up just like after making the calls directly, in the
+ * order they were recorded. The commands are executed one band of rows at
+ * a time, skipping the ones outside of each band or of the screen.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - CMDBUF is null.
+ *   3 - out of memory.
+ */
+int conge_cmdbuf_submit (conge_ctx*, conge_cmdbuf*);
+
+/*
+ * Create a sprite of W by H pixels, all of them transparent. Return null if
+ * out of memory, or the size isn't positive.
+ */
+conge_sprite* conge_sprite_new (int w, int h);
+
+/*
+ * Free the sprite. Does nothing if SPRITE is null.
+ */
+void conge_sprite_free (conge_sprite* sprite);
+
+/*
+ * Draw SPRITE onto the frame with its top left corner at (X; Y), leaving
+ * the pixels under its transparent ones alone. FLAGS are CONGE_FLIP_X,
+ * CONGE_FLIP_Y and CONGE_OPAQUE, or 0.
+ *
+ * The sprite is clipped to the screen once, and then copied row by row.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - SPRITE is null.
+ */
+int conge_blit (conge_ctx*, const conge_sprite* sprite, int x, int y,
+                int flags);
+
+/*
+ * The same as conge_blit, with only the W by H pixels of SPRITE starting at
+ * (SX; SY), which must be within it.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - SPRITE is null.
+ *   3 - the area isn't within SPRITE.
+ */
+int conge_blit_area (conge_ctx*, const conge_sprite* sprite, int sx, int sy,
+                     int w, int h, int x, int y, int flags);
+
+/*
+ * Draw a map of COLS by ROWS tiles with its top left corner at (X; Y).
+ * TILES holds an index per tile, row by row, into ATLAS: a sprite holding
+ * TILE_W by TILE_H tiles side by side, numbered row by row. Negative
+ * indices and the ones past the atlas leave their tile empty.
+ *
+ * Only the tiles on the screen are drawn.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - ATLAS or TILES is null.
+ *   3 - the tile size isn't positive, or larger than ATLAS.
+ */
+int conge_draw_tilemap (conge_ctx*, const conge_sprite* atlas,
+                        int tile_w, int tile_h, const int* tiles,
+                        int cols, int rows, int x, int y);
+
+/*
+ * Create a layer at DEPTH in the layer stack, above the ones of a lower
+ * depth and the others of the same depth. Return null if CTX is null or
+ * out of memory.
+ *
+ * A layer is a buffer of pixels as large as the screen, which
+ * conge_draw_into directs drawing into. The stack is composited into the
+ * frame from the bottom up, over a clear frame, and pixels of 0, which a
+ * new layer is made of, let the layers below show through; so do wide
+ * pixels with a character of 0. Each layer keeps track of the pixels drawn
+ * into it, and only the rows and columns where any layer changed are
+ * composited again, so the layers which stay the same cost nothing between
+ * frames, and the console is only sent what changed.
+ *
+ * While there are layers, the frame is kept between ticks as if
+ * CTX->retain was set, along with the subframe. Pixels drawn into the
+ * frame directly stay until a layer changes over them.
+ */
+conge_layer* conge_layer_new (conge_ctx*, int depth);
+
+/*
+ * Remove LAYER from the stack and free it, showing what it covered. Does
+ * nothing if CTX or LAYER is null.
+ */
+void conge_layer_free (conge_ctx*, conge_layer* layer);
+
+/*
+ * Draw into LAYER instead of the frame, or into the frame again if LAYER
+ * is null, until the end of the tick. CTX->frame, or CTX->wide_frame, then
+ * points to the layer's pixels, so that every drawing function and
+ * conge_get_pixel work on them.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - there's no frame yet; call it from the tick function.
+ */
+int conge_draw_into (conge_ctx*, conge_layer* layer);
+
+/*
+ * Make the whole LAYER transparent. Only the pixels drawn into it since it
+ * was last cleared are touched.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - LAYER is null.
+ */
+int conge_clear_layer (conge_ctx*, conge_layer* layer);
+
+/*
+ * Show LAYER if VISIBLE is set, which new layers are, or hide it.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - LAYER is null.
+ */
+int conge_show_layer (conge_ctx*, conge_layer* layer, int visible);
+
+/*
+ * Create a canvas of W by H pixels in FORMAT, one of CONGE_FORMAT_*, all of
+ * them transparent. Return null if out of memory, or the size isn't
+ * positive, or FORMAT is unknown.
+ *
+ * A canvas is drawn into like the frame, but off the screen and without a
+ * context, so that something expensive to draw can be drawn once, kept,
+ * and blitted onto frames with conge_blit_canvas. Its fields can also be
+ * set up by hand, to draw into pixels of your own: a part of a larger
+ * canvas, for instance, with the larger one's stride.
+ */
+conge_canvas* conge_canvas_new (int w, int h, int format);
+
+/*
+ * Free a canvas made by conge_canvas_new. Does nothing if CANVAS is null.
+ */
+void conge_canvas_free (conge_canvas* canvas);
+
+/*
+ * Only draw into the W by H rectangle of CANVAS whose top-left corner is
+ * at (X; Y), or into the part of it within the canvas. A new canvas draws
+ * into all of it.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CANVAS is null.
+ */
+int conge_canvas_clip (conge_canvas* canvas, int x, int y, int w, int h);
+
+/*
+ * Make the pixels of CANVAS within its clip rectangle transparent: 0, or
+ * with a character of 0 if the canvas is wide.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CANVAS is null.
+ */
+int conge_canvas_clear (conge_canvas* canvas);
+
+/*
+ * The same as conge_fill, conge_draw_line, conge_fill_triangle,
+ * conge_fill_rect and conge_write_string, and their wide versions, drawing
+ * into CANVAS within its clip rectangle instead of into the frame. They
+ * can be called at any time, and from any thread, as long as no other
+ * thread uses the same pixels.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CANVAS is null.
+ *   2 - STRING is null.
+ */
+int conge_canvas_fill (conge_canvas* canvas, int x, int y, conge_pixel);
+int conge_canvas_line (conge_canvas* canvas, int x0, int y0, int x1, int y1,
+                       conge_pixel);
+int conge_canvas_triangle (conge_canvas* canvas, int x0, int y0,
+                           int x1, int y1, int x2, int y2, conge_pixel);
+int conge_canvas_rect (conge_canvas* canvas, int x, int y, int w, int h,
+                       conge_pixel);
+int conge_canvas_string (conge_canvas* canvas, const char* string,
+                         int x, int y, int fg, int bg);
+int conge_canvas_fill_wide (conge_canvas* canvas, int x, int y,
+                            conge_wide_pixel);
+int conge_canvas_line_wide (conge_canvas* canvas, int x0, int y0,
+                            int x1, int y1, conge_wide_pixel);
+int conge_canvas_triangle_wide (conge_canvas* canvas, int x0, int y0,
+                                int x1, int y1, int x2, int y2,
+                                conge_wide_pixel);
+int conge_canvas_rect_wide (conge_canvas* canvas, int x, int y, int w, int h,
+                            conge_wide_pixel);
+int conge_canvas_string_wide (conge_canvas* canvas, const char* string,
+                              int x, int y, unsigned int fg,
+                              unsigned int bg);
+
+/*
+ * The same as conge_blit and conge_draw_tilemap, drawing into CANVAS.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CANVAS is null.
+ *   2 - SPRITE, or ATLAS or TILES, is null.
+ *   3 - the tile size isn't positive, or larger than ATLAS.
+ */
+int conge_canvas_blit (conge_canvas* canvas, const conge_sprite* sprite,
+                       int x, int y, int flags);
+int conge_canvas_tilemap (conge_canvas* canvas, const conge_sprite* atlas,
+                          int tile_w, int tile_h, const int* tiles,
+                          int cols, int rows, int x, int y);
+
+/*
+ * Draw CANVAS onto the frame with its top left corner at (X; Y), as
+ * conge_blit draws a sprite. Narrow pixels equal to the canvas' key and
+ * wide ones with a character of 0 are transparent, unless FLAGS include
+ * CONGE_OPAQUE, and the pixels are converted to the frame's format.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - CANVAS is null.
+ */
+int conge_blit_canvas (conge_ctx*, const conge_canvas* canvas, int x, int y,
+                       int flags);
+
+/*
+ * The same, drawing FROM into the canvas TO. They mustn't share pixels.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - TO is null.
+ *   2 - FROM is null.
+ */
+int conge_canvas_blit_canvas (conge_canvas* to, const conge_canvas* from,
+                              int x, int y, int flags);
+
+/*
+ * Push a viewport: until it's popped, the drawing functions only draw
+ * within the W by H rectangle at (X; Y), and (X; Y) is where their (0; 0)
+ * is. Both are relative to the viewport pushed before, if any, and so
+ * is the rectangle clipped to it; a panel of a layout can then be drawn
+ * with coordinates of its own, whatever panel it's placed in.
+ *
+ * Geometry is clipped to the rectangle once per call, before any pixel is
+ * touched, and the calls drawing nothing inside it return right away.
+ * This applies to everything drawn into the frame or the current layer:
+ * the shapes, strings, sprites, tilemaps and canvases, and the subpixels
+ * too, with the rectangle scaled to them. Command buffers are recorded in
+ * the coordinates of the screen and ignore it, and so does
+ * conge_get_pixel.
+ *
+ * The viewports are all popped at the start of each tick.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - CONGE_MAX_VIEWPORTS are pushed already.
+ */
+int conge_push_viewport (conge_ctx*, int x, int y, int w, int h);
+
+/*
+ * The same, keeping the origin where it was: only the clip rectangle
+ * changes. Pop it with conge_pop_viewport.
+ */
+int conge_push_clip (conge_ctx*, int x, int y, int w, int h);
+
+/*
+ * Pop the viewport pushed last, going back to the one before.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - no viewport is pushed.
+ */
+int conge_pop_viewport (conge_ctx*);
+
+/* Formats for conge_trace_dump. */
+enum
+  {
+    CONGE_TRACE_CHROME, /* trace event JSON, for chrome://tracing */
+    CONGE_TRACE_CSV, /* a row per frame, times in microseconds */
+  };
+
+/*
+ * Start tracing the latest FRAMES frames: when their phases started, how
+ * long they took, and how much the presenter did. Starting again forgets
+ * the frames traced so far.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - FRAMES is negative or zero.
+ *   3 - out of memory.
+ *   4 - tracing was compiled out with CONGE_NO_TRACE.
+ */
+int conge_trace_start (conge_ctx*, int frames);
+
+/*
+ * Stop tracing, and forget the traced frames.
+ */
+void conge_trace_stop (conge_ctx*);
+
+/*
+ * Return the amount of traced frames.
+ */
+int conge_trace_count (conge_ctx*);
+
+/*
+ * Return a traced frame, the oldest being at INDEX 0, or null if there's
+ * no such frame.
+ */
+const conge_frame_stats* conge_trace_get (conge_ctx*, int index);
+
+/*
+ * Write the traced frames to FILE in one of the CONGE_TRACE_* formats.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - FILE is null.
+ *   3 - unknown FORMAT.
+ */
+int conge_trace_dump (conge_ctx*, FILE* file, int format);
+
+/*
+ * Rasterize submitted command buffers with THREADS threads, counting the
+ * calling one, or with one per processor if THREADS is 0. The bands of
+ * rows are shared between the threads, so the frame ends up the same as
+ * with a single thread, which is the default.
+ *
+ * Return codes:
+ *   0 - success.
+ *   1 - CTX is null.
+ *   2 - THREADS is negative.
+ *   3 - the threads couldn't be started; CTX stays single-threaded.
+ */
+int conge_set_threads (conge_ctx*, int threads);
+
+/*
+ * Internal: close the console, stopping the input thread and presenting the
+ * last frames first.
+ */
+void conge_close (conge_ctx*);
+
+/*
+ * Internal: sleep until the next frame is due, ctx->timestep after the
+ * current one was, or until input arrives if ctx->idle is set.
+ */
+void conge_wait_for_frame (conge_ctx*);
+
+/*
+ * Internal: time the frame's phases, if tracing.
+ */
+void conge_trace_begin (conge_ctx*, int phase);
+void conge_trace_end (conge_ctx*, int phase);
+
+/*
+ * Internal: time the phases of the frame being presented, if it's traced.
+ */
+void conge_trace_present_begin (conge_ctx*, int phase);
+void conge_trace_present_end (conge_ctx*, int phase);
+
+/*
+ * Internal: trace the presentation of SWAP as part of the current frame.
+ * PIPELINED is set if it happened on the presenter thread.
+ */
+void conge_trace_presented (conge_ctx*, const conge_swap* swap, int pipelined);
+
+/*
+ * Internal: finish tracing the last frame, and start on the next one.
+ */
+void conge_trace_frame (conge_ctx*);
+
+/*
+ * Internal: make sure the screen buffers match the window size, take the
+ * next buffer of the swap chain as the frame, and clear what was drawn into
+ * it unless the frame is retained. Return 1 if memory allocation failed.
+ */
+int conge_prepare_frame (conge_ctx*);
+
+/*
+ * Internal: composite the layers and pack the subpixels into the current
+ * frame, present it or hand it over to the presenter thread, and take the
+ * measurements of the last frame presented.
+ */
+void conge_draw_frame (conge_ctx*);
+
+/*
+ * Internal: draw SWAP on the console.
+ *
+ * All changed pixels are encoded as VT escape sequences into a single
+ * buffer which is then written to the console at once.
+ */
+void conge_present_swap (conge_ctx*, conge_swap* swap);
+
+/*
+ * Internal: wait until the swap chain has a buffer the presenter is done
+ * with, and return it.
+ */
+conge_swap* conge_acquire_swap (conge_ctx*);
+
+/*
+ * Internal: wait until every frame handed over has been presented. The
+ * presenter thread doesn't touch the context again until the next one is.
+ */
+void conge_finish_presenting (conge_ctx*);
+
+/*
+ * Internal: stop the presenter thread, if any, after it's done.
+ */
+void conge_stop_presenter (conge_ctx*);
+
+/*
+ * Internal: restore the console colors and cursor position before exiting.
+ */
+void conge_reset_output (conge_ctx*);
+
+/*
+ * Internal: console color numbers in the order VT sequences expect them.
+ */
+extern const int conge_vt_colors[8];
+
+/*
+ * Internal: hide the console cursor with the next frame.
+ */
+void conge_disable_cursor (conge_ctx*);
+
+/*
+ * Internal: queue a string for output, or write the queued output.
+ */
+void conge_put_string (conge_ctx*, const char*);
+void conge_flush_output (conge_ctx*);
+
+/*
+ * Internal: extend row Y's dirty span to cover columns X0 to X1.
+ */
+void conge_mark_dirty (conge_ctx*, int y, int x0, int x1);
+
+/*
+ * Internal: make TARGET draw into the whole frame.
+ */
+void conge_frame_target (conge_ctx*, conge_target* target);
+
+/*
+ * Internal: make TARGET draw into the frame within the current viewport,
+ * and set DX and DY to what moves coordinates to its origin. Return 1 if
+ * nothing is left of its clip rectangle.
+ */
+int conge_view_target (conge_ctx*, conge_target* target, int* dx, int* dy);
+
+/*
+ * Internal: move (X; Y) to the origin of the current viewport. Return 1 if
+ * it's outside the viewport's clip rectangle; the screen isn't checked.
+ */
+int conge_view_point (conge_ctx*, int* x, int* y);
+
+/*
+ * Internal: the same for the subframe, in subpixels.
+ */
+int conge_subframe_target (conge_ctx*, conge_target* target,
+                           int* dx, int* dy);
+
+/*
+ * Internal: return VALUE + BY, saturated to the range of int.
+ */
+int conge_translate (int value, int by);
+
+/*
+ * Internal: make TARGET draw into CANVAS, within its clip rectangle and
+ * its bounds. Return 1 if nothing is left of the clip rectangle.
+ */
+int conge_canvas_target (const conge_canvas* canvas, conge_target* target);
+
+/*
+ * Internal: return the subpixels per cell of a CONGE_SUBPIXELS_* mode
+ * across, and down.
+ */
+int conge_subpixels_across (int mode);
+int conge_subpixels_down (int mode);
+
+/*
+ * Internal: clear what was drawn into the subframe, unless it's retained.
+ */
+void conge_prepare_subframe (conge_ctx*);
+
+/*
+ * Internal: pack the subpixels drawn during the tick into the frame.
+ */
+void conge_pack_subpixels (conge_ctx*);
+
+/*
+ * Internal: return 1 if the frame is kept between ticks: if CTX->retain is
+ * set, or there are layers.
+ */
+int conge_frame_retained (conge_ctx*);
+
+/*
+ * Internal: make the layers' buffers match the frame's, and have all of
+ * them composited again. Return 1 if memory allocation failed.
+ */
+int conge_fit_layers (conge_ctx*);
+
+/*
+ * Internal: composite the layers into the frame where they changed, and
+ * draw into the frame again.
+ */
+void conge_composite_layers (conge_ctx*);
+
+/*
+ * Internal: free all of the layers.
+ */
+void conge_free_layers (conge_ctx*);
+
+/*
+ * Internal: make CELL fill with PIXEL, or WIDE, in TARGET's format.
+ */
+void conge_narrow_cell (const conge_target*, conge_pixel pixel,
+                        conge_cell* cell);
+void conge_wide_cell (const conge_target*, conge_wide_pixel wide,
+                      conge_cell* cell);
+
+/*
+ * Internal: fill COUNT pixels with FILL.
+ */
+void conge_fill_pixels (conge_pixel* pixels, int count, conge_pixel fill);
+void conge_fill_wide_pixels (conge_wide_pixel* pixels, int count,
+                             conge_wide_pixel fill);
+void conge_fill_colors (unsigned int* colors, int count, unsigned int fill);
+
+/*
+ * Internal: floor division by a positive number.
+ */
+long long conge_floor_div (long long numerator, long long denominator);
+
+/*
+ * Internal: copy COUNT pixels from FROM to TARGET at OFFSET, as conge_blit
+ * does with FLAGS, except for CONGE_FLIP_Y. The pixels must be within
+ * TARGET, which isn't marked dirty.
+ */
+void conge_blit_row (const conge_target*, long offset,
+                     const conge_pixel* from, int count, conge_pixel key,
+                     int flags);
+
+/*
+ * Internal: the same for wide pixels, which are transparent if their
+ * character is 0. Narrow targets get the nearest narrow pixels.
+ */
+void conge_blit_wide_row (const conge_target*, long offset,
+                          const conge_wide_pixel* from, int count,
+                          int flags);
+
+/*
+ * Internal: draw the W by H pixels of SOURCE starting at (SX; SY), which
+ * must be within it, at (X; Y), as conge_blit_area does. The narrow pixels
+ * equal to KEY are transparent.
+ */
+void conge_raster_blit (const conge_target*, const conge_target* source,
+                        conge_pixel key, int sx, int sy, int w, int h,
+                        int x, int y, int flags);
+
+/*
+ * Internal: make TARGET read from SPRITE, for conge_raster_blit.
+ */
+void conge_sprite_target (const conge_sprite* sprite, conge_target* target);
+
+/*
+ * Internal: draw a tilemap into TARGET, as conge_draw_tilemap does with
+ * valid arguments.
+ */
+void conge_raster_tilemap (const conge_target*, const conge_sprite* atlas,
+                           int tile_w, int tile_h, const int* tiles,
+                           int cols, int rows, int x, int y);
+
+/*
+ * Internal: copy COUNT pixels from FROM to TO, except for the ones equal
+ * to KEY. If REVERSE is set, FROM is read backwards: TO[I] is FROM[-I].
+ */
+typedef void (*conge_blit_pixels_func) (conge_pixel* to,
+                                        const conge_pixel* from, int count,
+                                        conge_pixel key, int reverse);
+
+/*
+ * Internal: the fastest conge_blit_pixels_func the CPU supports.
+ */
+extern conge_blit_pixels_func conge_blit_pixels;
+
+/*
+ * Internal: return the length of STRING, or LIMIT if it's longer, without
+ * looking past it.
+ */
+int conge_string_length (const char* string, long long limit);
+
+/*
+ * Internal: decode the UTF-8 character at STRING, up to END, and return
+ * the byte after it. Malformed bytes stand for themselves, as in Latin-1.
+ */
+const char* conge_decode_utf8 (const char* string, const char* end,
+                               unsigned int* character);
+
+/*
+ * Internal: return the 16-color console color nearest to a wide one.
+ */
+int conge_nearest_color (unsigned int color);
+
+/*
+ * Internal: the rasterizers. They clip to TARGET's clip rectangle before
+ * touching any pixel, and don't check their arguments.
+ */
+void conge_raster_span (const conge_target*, int y, int x0, int x1,
+                        const conge_cell* fill);
+void conge_raster_rect (const conge_target*, int x, int y, int w, int h,
+                        const conge_cell* fill);
+void conge_raster_string (const conge_target*, const char* string,
+                          int length, int x, int y, int fg, int bg);
+void conge_raster_wide_string (const conge_target*, const char* string,
+                               int length, int x, int y,
+                               unsigned int fg, unsigned int bg);
+void conge_raster_line (const conge_target*, int x0, int y0, int x1, int y1,
+                        const conge_cell* fill);
+void conge_raster_triangle (const conge_target*, int x0, int y0,
+                            int x1, int y1, int x2, int y2,
+                            const conge_cell* fill);
+
+/* Internal: instruction sets the vectorized helpers can use. */
+enum
+  {
+    CONGE_SIMD_SCALAR,
+    CONGE_SIMD_SSE2,
+    CONGE_SIMD_AVX2,
+  };
+
+/*
+ * Internal: return the index of the first pixel between FROM (inclusive)
+ * and TO (exclusive) which is equal in A and B if EQUAL is set, or differs
+ * otherwise. Return TO if there's no such pixel.
+ */
+typedef int (*conge_find_pixel_func) (const conge_pixel* a,
+                                      const conge_pixel* b,
+                                      int from, int to, int equal);
+
+/*
+ * Internal: the fastest conge_find_pixel_func the CPU supports.
+ */
+extern conge_find_pixel_func conge_find_pixel;
+
+/*
+ * Internal: the same for wide pixels.
+ */
+int conge_find_wide_pixel (const conge_wide_pixel* a,
+                           const conge_wide_pixel* b,
+                           int from, int to, int equal);
+
+/*
+ * Internal: return 1 if the CPU supports the given CONGE_SIMD_* set.
+ */
+int conge_cpu_has (int isa);
+
+/*
+ * Internal: return the conge_find_pixel_func using the given CONGE_SIMD_*
+ * set, or NULL if the CPU doesn't support it.
+ */
+conge_find_pixel_func conge_get_find_pixel (int isa);
+
+/*
+ * Internal: handle input for the frame.
+ */
+void conge_handle_input (conge_ctx*);
+
+/*
+ * Internal: set or unset a key's bit in the key bitflag.
+ */
+void conge_set_key (conge_ctx*, int code, int down);
+
+/*
+ * Internal: apply an input event to the key, button and mouse state.
+ */
+void conge_apply_event (conge_ctx*, const conge_event*);
+
+/*
+ * Internal: apply an input event stamped with the backend's time, and queue
+ * it for conge_next_event.
+ */
+void conge_push_event (conge_ctx*, conge_event*);
+
+/*
+ * Internal: stamp an event a backend read with the time, and push it, or
+ * hand it to the main thread if called on the input thread.
+ */
+void conge_read_event (conge_ctx*, conge_event*);
+
+/*
+ * Internal: push the events the input thread read, or read them now if
+ * there is no such thread.
+ */
+void conge_take_input (conge_ctx*);
+
+/*
+ * Internal: wait until input arrives, or SECONDS pass if positive.
+ */
+void conge_wait_for_input (conge_ctx*, double seconds);
+
+/*
+ * Internal: start the input thread, returning non-zero on failure, or stop
+ * it. It only runs while the console is open.
+ */
+int conge_start_input_thread (conge_ctx*);
+void conge_stop_input_thread (conge_ctx*);
+
+/*
+ * Internal: the console backend, implemented for each platform.
+ */
+extern const conge_backend conge_console_backend;
+void conge_init_console (conge_ctx*); /* find the console */
+double conge_console_time (conge_ctx*); /* CTX may be null */
+
+/*
+ * Internal: free the headless state, if any.
+ */
+void conge_free_headless (conge_ctx*);
+
+/*
+ * Internal: threads. The functions starting something return non-zero on
+ * failure.
+ */
+typedef void (*conge_thread_func) (void* data);
+
+int conge_thread_start (conge_thread*, conge_thread_func, void* data);
+void conge_thread_join (conge_thread*);
+
+int conge_mutex_init (conge_mutex*);
+void conge_mutex_destroy (conge_mutex*);
+void conge_mutex_lock (conge_mutex*);
+void conge_mutex_unlock (conge_mutex*);
+
+int conge_cond_init (conge_cond*);
+void conge_cond_destroy (conge_cond*);
+void conge_cond_wait (conge_cond*, conge_mutex*);
+void conge_cond_broadcast (conge_cond*);
+
+/*
+ * Internal: wait like conge_cond_wait, but for SECONDS at most. Return
+ * non-zero if it timed out.
+ */
+int conge_cond_timed_wait (conge_cond*, conge_mutex*, double seconds);
+
+/*
+ * Internal: add AMOUNT to VALUE atomically, returning the sum.
+ */
+long conge_atomic_add (volatile long* value, long amount);
+
+/*
+ * Internal: load VALUE with acquire ordering, or store it with release
+ * ordering, so that whatever a thread wrote before the store is visible to
+ * the one which loads what it stored.
+ */
+long conge_atomic_load (volatile long* value);
+void conge_atomic_store (volatile long* value, long new_value);
+
+/*
+ * Internal: the number of processors, at least 1.
+ */
+int conge_cpu_count (void);
+
+/*
+ * Internal: start a pool of THREADS - 1 workers, or return null.
+ */
+conge_pool* conge_pool_new (int threads);
+void conge_pool_free (conge_pool*);
+
+/*
+ * Internal: call JOB (DATA, I) for each I from 0 to COUNT - 1, spread
+ * between the workers and the calling thread, and wait for all of them.
+ */
+typedef void (*conge_job) (void* data, int index);
+
+void conge_pool_run (conge_pool*, conge_job job, void* data, int count);
 
 /* Color names. */
 enum
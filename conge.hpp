@@ -8,6 +8,7 @@
 // Silence some stupid warnings.
 #define _CRT_SECURE_CPP_OVERLOAD_STANDARD_NAMES 1
 
+#include <cstring>
 #include <string>
 
 extern "C"
@@ -0,0 +1,978 @@
+/*
+ * conge_bench.c - ConGE benchmarks.
+ *
+ * Every result is printed as a line of JSON, so the output of different
+ * commits can be collected and compared. The optional argument is included
+ * in every result as its label, e.g. the commit being measured.
+ *
+ * The "diff" results measure conge_find_pixel alone. The "frame" results
+ * measure a workload drawing into a headless context, whose output is
+ * counted but not interpreted, and conge_draw_frame presenting it: the
+ * raster figures are per pixel drawn, the present figures per pixel on the
+ * screen, in either pixel format. The "pipeline" results measure whole
+ * frames of the same, with a presenter thread and swap chain or without one.
+ * The "canvas" results measure the rasterizers alone, drawing into a canvas
+ * without any context.
+ */
+
+#include "conge.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+/* Run every measurement for at least this long, in seconds. */
+#define BENCH_DURATION 0.2
+
+/*
+ * Return a monotonic time in seconds.
+ */
+double
+bench_now (void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter, frequency;
+
+  QueryPerformanceCounter (&counter);
+  QueryPerformanceFrequency (&frequency);
+
+  return (double) counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+#endif
+}
+
+/* Included in every result. */
+const char* bench_label = "";
+
+/*
+ * A tiny deterministic random number generator: return 0 to N - 1.
+ */
+unsigned int bench_seed = 1;
+
+int
+bench_random (int n)
+{
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return (bench_seed >> 8) % n;
+}
+
+/*
+ * Measure how fast each conge_find_pixel_func finds the runs of changed
+ * pixels, with CHANGED being the fraction of pixels that differ.
+ */
+void
+bench_diff (int cols, int rows, double changed)
+{
+  const char* names[] = { "scalar", "sse2", "avx2" };
+
+  int area = rows * cols;
+  conge_pixel* front = malloc (area * sizeof (*front));
+  conge_pixel* back = malloc (area * sizeof (*back));
+
+  int i, isa;
+
+  if (front == NULL || back == NULL)
+    {
+      free (front);
+      free (back);
+      return;
+    }
+
+  for (i = 0; i < area; i++)
+    {
+      front[i] = conge_new_pixel (32 + bench_random (95), bench_random (16),
+                                  bench_random (16));
+
+      /* Flip the foreground color of the changed pixels. */
+      back[i] = front[i];
+
+      if (bench_random (1000000) < changed * 1000000)
+        back[i] ^= 0x100;
+    }
+
+  for (isa = CONGE_SIMD_SCALAR; isa <= CONGE_SIMD_AVX2; isa++)
+    {
+      conge_find_pixel_func find = conge_get_find_pixel (isa);
+
+      double start, elapsed;
+      long frames = 0, found = 0;
+
+      if (find == NULL)
+        continue;
+
+      start = bench_now ();
+
+      do
+        {
+          int y;
+
+          for (y = 0; y < rows; y++)
+            {
+              const conge_pixel* a = front + y * cols;
+              const conge_pixel* b = back + y * cols;
+              int x = 0;
+
+              while ((x = find (a, b, x, cols, 0)) < cols)
+                {
+                  int end = find (a, b, x + 1, cols, 1);
+
+                  found += end - x;
+                  x = end;
+                }
+            }
+
+          frames++;
+          elapsed = bench_now () - start;
+        }
+      while (elapsed < BENCH_DURATION);
+
+      printf ("{\"label\": \"%s\", \"bench\": \"diff\", \"impl\": \"%s\", "
+              "\"cols\": %d, "
+              "\"rows\": %d, \"changed\": %g, \"changed_cells\": %ld, "
+              "\"ns_per_cell\": %.4f, \"cells_per_s\": %.0f}\n",
+              bench_label, names[isa], cols, rows, changed, found / frames,
+              1e9 * elapsed / ((double) frames * area),
+              (double) frames * area / elapsed);
+    }
+
+  free (front);
+  free (back);
+}
+
+/*
+ * A workload draws a frame and returns the amount of pixels it drew.
+ */
+typedef long (*bench_workload) (conge_ctx* ctx, int frame);
+
+/*
+ * Scattered 4x3 sprites moving across the screen, mostly left alone.
+ */
+long
+bench_sprites (conge_ctx* ctx, int frame)
+{
+  conge_pixel fill = conge_new_pixel ('@', CONGE_YELLOW, CONGE_BLUE);
+  int i, x, y;
+
+  for (i = 0; i < 50; i++)
+    {
+      int sx = (37 * i + frame) % ctx->cols;
+      int sy = (17 * i) % ctx->rows;
+
+      for (y = sy; y < sy + 3; y++)
+        for (x = sx; x < sx + 4; x++)
+          conge_fill (ctx, x, y, fill);
+    }
+
+  return 50 * 4 * 3;
+}
+
+/* The tiles of the tilemap workloads, and their map's size. */
+#define BENCH_TILE_W 4
+#define BENCH_TILE_H 2
+#define BENCH_TILES 16
+#define BENCH_MAP_COLS 128
+#define BENCH_MAP_ROWS 64
+
+/* The map, enough to cover the largest screen. */
+int bench_map[BENCH_MAP_COLS * BENCH_MAP_ROWS];
+
+/*
+ * Return an atlas of BENCH_TILES tiles side by side, a quarter of their
+ * pixels transparent, and fill BENCH_MAP with them the first time.
+ */
+conge_sprite*
+bench_atlas (void)
+{
+  static conge_sprite* atlas = NULL;
+  int i;
+
+  if (atlas != NULL)
+    return atlas;
+
+  atlas = conge_sprite_new (BENCH_TILES * BENCH_TILE_W, BENCH_TILE_H);
+
+  if (atlas == NULL)
+    return NULL;
+
+  bench_seed = 1;
+
+  for (i = 0; i < atlas->w * atlas->h; i++)
+    if (bench_random (4) > 0)
+      atlas->pixels[i] = conge_new_pixel ('a' + bench_random (26),
+                                          bench_random (16),
+                                          bench_random (16));
+
+  for (i = 0; i < BENCH_MAP_COLS * BENCH_MAP_ROWS; i++)
+    bench_map[i] = bench_random (BENCH_TILES);
+
+  return atlas;
+}
+
+/*
+ * A map of tiles covering the screen and scrolling across it, drawn a
+ * pixel at a time.
+ */
+long
+bench_tiles_fill (conge_ctx* ctx, int frame)
+{
+  conge_sprite* atlas = bench_atlas ();
+  int cols = CONGE_MIN (BENCH_MAP_COLS, ctx->cols / BENCH_TILE_W + 2);
+  int rows = CONGE_MIN (BENCH_MAP_ROWS, ctx->rows / BENCH_TILE_H + 1);
+  int col, row, x, y;
+
+  if (atlas == NULL)
+    return 1;
+
+  /* Only the tiles on the screen, as the tilemap does. */
+  for (row = 0; row < rows; row++)
+    for (col = 0; col < cols; col++)
+      {
+        int tile = bench_map[BENCH_MAP_COLS * row + col];
+        int tx = col * BENCH_TILE_W - frame % BENCH_TILE_W;
+        int ty = row * BENCH_TILE_H;
+
+        for (y = 0; y < BENCH_TILE_H; y++)
+          for (x = 0; x < BENCH_TILE_W; x++)
+            {
+              conge_pixel pixel = atlas->pixels[atlas->w * y
+                                                + tile * BENCH_TILE_W + x];
+
+              if (pixel != atlas->key)
+                conge_fill (ctx, tx + x, ty + y, pixel);
+            }
+      }
+
+  return (long) ctx->cols * ctx->rows;
+}
+
+/*
+ * The same with conge_draw_tilemap.
+ */
+long
+bench_tilemap (conge_ctx* ctx, int frame)
+{
+  conge_sprite* atlas = bench_atlas ();
+
+  if (atlas == NULL)
+    return 1;
+
+  conge_draw_tilemap (ctx, atlas, BENCH_TILE_W, BENCH_TILE_H, bench_map,
+                      BENCH_MAP_COLS, BENCH_MAP_ROWS,
+                      -(frame % BENCH_TILE_W), 0);
+
+  return (long) ctx->cols * ctx->rows;
+}
+
+/*
+ * A true color gradient over the whole screen, scrolling a pixel a frame.
+ */
+long
+bench_gradient (conge_ctx* ctx, int frame)
+{
+  int x, y;
+
+  for (y = 0; y < ctx->rows; y++)
+    for (x = 0; x < ctx->cols; x++)
+      {
+        int shade = (x + frame) & 0xFF;
+        unsigned int bg = CONGE_RGB (shade, y & 0xFF, 255 - shade);
+
+        conge_fill_wide (ctx, x, y, conge_new_wide_pixel (' ', bg, bg));
+      }
+
+  return (long) ctx->cols * ctx->rows;
+}
+
+/*
+ * The lines of bench_lines, in subpixels.
+ */
+long
+bench_subpixel_lines (conge_ctx* ctx, int frame)
+{
+  long cells = 0;
+  int i;
+
+  bench_seed = frame + 1;
+
+  for (i = 0; i < 100; i++)
+    {
+      int x0 = bench_random (ctx->sub_cols + 40) - 20;
+      int y0 = bench_random (ctx->sub_rows + 40) - 20;
+      int x1 = bench_random (ctx->sub_cols + 40) - 20;
+      int y1 = bench_random (ctx->sub_rows + 40) - 20;
+
+      conge_draw_subpixel_line (ctx, x0, y0, x1, y1,
+                                CONGE_PALETTE (CONGE_BRIGHT_GREEN));
+      cells += CONGE_MAX (abs (x1 - x0), abs (y1 - y0)) + 1;
+    }
+
+  return cells;
+}
+
+/*
+ * The triangles of bench_triangles, in subpixels.
+ */
+long
+bench_subpixel_triangles (conge_ctx* ctx, int frame)
+{
+  long cells = 0;
+  int i;
+
+  bench_seed = frame + 1;
+
+  for (i = 0; i < 500; i++)
+    {
+      int x = bench_random (ctx->sub_cols), y = bench_random (ctx->sub_rows);
+      int w = 1 + bench_random (24), h = 1 + bench_random (16);
+
+      conge_fill_subpixel_triangle (ctx, x, y + h, x + w, y + h, x + w / 2, y,
+                                    CONGE_PALETTE (i % 16));
+      cells += w * h / 2;
+    }
+
+  return cells;
+}
+
+/*
+ * Every pixel filled one by one, in a color which changes every frame.
+ */
+long
+bench_fill (conge_ctx* ctx, int frame)
+{
+  conge_pixel fill = conge_new_pixel ('#', frame % 16, (frame + 1) % 16);
+  int x, y;
+
+  for (y = 0; y < ctx->rows; y++)
+    for (x = 0; x < ctx->cols; x++)
+      conge_fill (ctx, x, y, fill);
+
+  return (long) ctx->rows * ctx->cols;
+}
+
+/*
+ * Lines between random points, partly off-screen.
+ */
+long
+bench_lines (conge_ctx* ctx, int frame)
+{
+  conge_pixel fill = conge_new_pixel ('*', CONGE_BRIGHT_GREEN, CONGE_BLACK);
+  long cells = 0;
+  int i;
+
+  bench_seed = frame + 1;
+
+  for (i = 0; i < 100; i++)
+    {
+      int x0 = bench_random (ctx->cols + 40) - 20;
+      int y0 = bench_random (ctx->rows + 40) - 20;
+      int x1 = bench_random (ctx->cols + 40) - 20;
+      int y1 = bench_random (ctx->rows + 40) - 20;
+
+      conge_draw_line (ctx, x0, y0, x1, y1, fill);
+      cells += CONGE_MAX (abs (x1 - x0), abs (y1 - y0)) + 1;
+    }
+
+  return cells;
+}
+
+/*
+ * Small triangles like the ones of a chart, in counter-clockwise order.
+ */
+long
+bench_triangles (conge_ctx* ctx, int frame)
+{
+  long cells = 0;
+  int i;
+
+  bench_seed = frame + 1;
+
+  for (i = 0; i < 500; i++)
+    {
+      int x = bench_random (ctx->cols), y = bench_random (ctx->rows);
+      int w = 1 + bench_random (12), h = 1 + bench_random (8);
+
+      conge_fill_triangle (ctx, x, y + h, x + w, y + h, x + w / 2, y,
+                           conge_new_pixel (' ', CONGE_BLACK, i % 16));
+      cells += w * h / 2;
+    }
+
+  return cells;
+}
+
+/*
+ * Text all over the screen, scrolling by a character every frame.
+ */
+long
+bench_text (conge_ctx* ctx, int frame)
+{
+  const char* text = "The quick brown fox jumps over the lazy dog. ";
+  char line[512];
+  int i, y, length = strlen (text);
+
+  for (y = 0; y < ctx->rows; y++)
+    {
+      for (i = 0; i < ctx->cols && i < sizeof (line) - 1; i++)
+        line[i] = text[(i + y + frame) % length];
+
+      line[i] = '\0';
+      conge_write_string (ctx, line, 0, y, CONGE_WHITE, CONGE_BLACK);
+    }
+
+  return (long) ctx->rows * ctx->cols;
+}
+
+/*
+ * The same text every frame: nothing to present.
+ */
+long
+bench_static_text (conge_ctx* ctx, int frame)
+{
+  return bench_text (ctx, 0);
+}
+
+/*
+ * A dashboard of small panels, each with a border, a title and a chart.
+ */
+long
+bench_widgets (conge_ctx* ctx, conge_cmdbuf* cmdbuf)
+{
+  conge_pixel panel = conge_new_pixel (' ', CONGE_WHITE, CONGE_BLUE);
+  conge_pixel border = conge_new_pixel ('#', CONGE_AQUA, CONGE_BLUE);
+  conge_pixel bar = conge_new_pixel (' ', CONGE_BLACK, CONGE_GREEN);
+  long cells = 0;
+  int x, y, i;
+
+  for (y = 0; y + 10 <= ctx->rows; y += 10)
+    for (x = 0; x + 20 <= ctx->cols; x += 20)
+      {
+        if (cmdbuf != NULL)
+          {
+            conge_cmdbuf_rect (cmdbuf, x, y, 20, 10, panel);
+            conge_cmdbuf_line (cmdbuf, x, y, x + 19, y, border);
+            conge_cmdbuf_line (cmdbuf, x, y + 9, x + 19, y + 9, border);
+            conge_cmdbuf_line (cmdbuf, x, y, x, y + 9, border);
+            conge_cmdbuf_line (cmdbuf, x + 19, y, x + 19, y + 9, border);
+            conge_cmdbuf_string (cmdbuf, "Widget", x + 2, y + 1,
+                                 CONGE_YELLOW, CONGE_BLUE);
+          }
+        else
+          {
+            conge_fill_rect (ctx, x, y, 20, 10, panel);
+            conge_draw_line (ctx, x, y, x + 19, y, border);
+            conge_draw_line (ctx, x, y + 9, x + 19, y + 9, border);
+            conge_draw_line (ctx, x, y, x, y + 9, border);
+            conge_draw_line (ctx, x + 19, y, x + 19, y + 9, border);
+            conge_write_string (ctx, "Widget", x + 2, y + 1,
+                                CONGE_YELLOW, CONGE_BLUE);
+          }
+
+        for (i = 0; i < 8; i++)
+          {
+            int top = y + 8 - (x / 20 + i + y / 10) % 6;
+
+            if (cmdbuf != NULL)
+              conge_cmdbuf_triangle (cmdbuf, x + 2 + 2 * i, y + 8,
+                                     x + 4 + 2 * i, y + 8, x + 3 + 2 * i, top,
+                                     bar);
+            else
+              conge_fill_triangle (ctx, x + 2 + 2 * i, y + 8,
+                                   x + 4 + 2 * i, y + 8, x + 3 + 2 * i, top,
+                                   bar);
+          }
+
+        cells += 20 * 10;
+      }
+
+  return cells;
+}
+
+long
+bench_widgets_direct (conge_ctx* ctx, int frame)
+{
+  return bench_widgets (ctx, NULL);
+}
+
+/*
+ * The same dashboard, recorded once and replayed every frame.
+ */
+long
+bench_widgets_cmdbuf (conge_ctx* ctx, int frame)
+{
+  static conge_cmdbuf* cmdbuf = NULL;
+  static long cells;
+
+  if (cmdbuf == NULL)
+    cmdbuf = conge_cmdbuf_new ();
+
+  /* Each screen size gets a new context, which starts at frame 0. */
+  if (frame == 0)
+    {
+      conge_cmdbuf_clear (cmdbuf);
+      cells = bench_widgets (ctx, cmdbuf);
+    }
+
+  conge_cmdbuf_submit (ctx, cmdbuf);
+  return cells;
+}
+
+/*
+ * A panel of the dashboard drawn into CANVAS, whose chart is one of six.
+ */
+void
+bench_widget_canvas (conge_canvas* canvas, int chart)
+{
+  conge_pixel panel = conge_new_pixel (' ', CONGE_WHITE, CONGE_BLUE);
+  conge_pixel border = conge_new_pixel ('#', CONGE_AQUA, CONGE_BLUE);
+  conge_pixel bar = conge_new_pixel (' ', CONGE_BLACK, CONGE_GREEN);
+  int i;
+
+  conge_canvas_rect (canvas, 0, 0, 20, 10, panel);
+  conge_canvas_line (canvas, 0, 0, 19, 0, border);
+  conge_canvas_line (canvas, 0, 9, 19, 9, border);
+  conge_canvas_line (canvas, 0, 0, 0, 9, border);
+  conge_canvas_line (canvas, 19, 0, 19, 9, border);
+  conge_canvas_string (canvas, "Widget", 2, 1, CONGE_YELLOW, CONGE_BLUE);
+
+  for (i = 0; i < 8; i++)
+    conge_canvas_triangle (canvas, 2 + 2 * i, 8, 4 + 2 * i, 8, 3 + 2 * i,
+                           8 - (chart + i) % 6, bar);
+}
+
+/*
+ * The same dashboard, with each of its six panels drawn once into a canvas
+ * and blitted every frame.
+ */
+long
+bench_widgets_canvas (conge_ctx* ctx, int frame)
+{
+  static conge_canvas* charts[6];
+  long cells = 0;
+  int x, y, i;
+
+  for (i = 0; i < 6; i++)
+    if (charts[i] == NULL)
+      {
+        charts[i] = conge_canvas_new (20, 10, CONGE_FORMAT_NARROW);
+        bench_widget_canvas (charts[i], i);
+      }
+
+  for (y = 0; y + 10 <= ctx->rows; y += 10)
+    for (x = 0; x + 20 <= ctx->cols; x += 20)
+      {
+        conge_blit_canvas (ctx, charts[(x / 20 + y / 10) % 6], x, y,
+                           CONGE_OPAQUE);
+        cells += 20 * 10;
+      }
+
+  return cells;
+}
+
+/*
+ * The same dashboard, with each panel drawn in a viewport of its own, in
+ * the panel's coordinates. Each panel also scrolls through a log of 50
+ * lines, of which only the few within its clip rectangle are drawn.
+ */
+long
+bench_widgets_viewports (conge_ctx* ctx, int frame)
+{
+  conge_pixel panel = conge_new_pixel (' ', CONGE_WHITE, CONGE_BLUE);
+  conge_pixel border = conge_new_pixel ('#', CONGE_AQUA, CONGE_BLUE);
+  conge_pixel bar = conge_new_pixel (' ', CONGE_BLACK, CONGE_GREEN);
+  long cells = 0;
+  int x, y, i;
+
+  for (y = 0; y + 10 <= ctx->rows; y += 10)
+    for (x = 0; x + 20 <= ctx->cols; x += 20)
+      {
+        conge_push_viewport (ctx, x, y, 20, 10);
+
+        conge_fill_rect (ctx, 0, 0, 20, 10, panel);
+        conge_draw_line (ctx, 0, 0, 19, 0, border);
+        conge_draw_line (ctx, 0, 9, 19, 9, border);
+        conge_draw_line (ctx, 0, 0, 0, 9, border);
+        conge_draw_line (ctx, 19, 0, 19, 9, border);
+        conge_write_string (ctx, "Widget", 2, 1, CONGE_YELLOW, CONGE_BLUE);
+
+        for (i = 0; i < 8; i++)
+          conge_fill_triangle (ctx, 2 + 2 * i, 8, 4 + 2 * i, 8, 3 + 2 * i,
+                               8 - (x / 20 + i + y / 10) % 6, bar);
+
+        /* The log, right of the title. */
+        conge_push_clip (ctx, 9, 1, 10, 3);
+
+        for (i = 0; i < 50; i++)
+          conge_write_string (ctx, "log entry", 9, 1 + i - frame % 50,
+                              CONGE_WHITE, CONGE_BLUE);
+
+        conge_pop_viewport (ctx);
+        conge_pop_viewport (ctx);
+
+        cells += 20 * 10;
+      }
+
+  return cells;
+}
+
+/*
+ * A log filling the screen, each entry wrapped to half its width and
+ * colored with markup, scrolling by an entry every frame.
+ */
+long
+bench_log (conge_ctx* ctx, int frame)
+{
+  const char* entries[] = {
+    "^f8[12:00:01]^r ^fAINFO^r connected to the server, listening on port "
+    "8080 for incoming requests",
+    "^f8[12:00:02]^r ^fEWARN^r the cache is ^fE93%^r full, evicting the "
+    "oldest entries first",
+    "^f8[12:00:03]^r ^fCERROR^r request ^f94711^r failed: connection reset "
+    "by peer",
+  };
+  int w = CONGE_MAX (1, ctx->cols / 2), y, i;
+
+  conge_fill_rect (ctx, 0, 0, ctx->cols, ctx->rows,
+                   conge_new_pixel (' ', CONGE_WHITE, CONGE_BLACK));
+
+  for (y = 0, i = frame; y < ctx->rows; y += 3, i++)
+    conge_draw_text (ctx, entries[i % 3], 0, y, w, CONGE_WRAP | CONGE_MARKUP,
+                     CONGE_WHITE, CONGE_BLACK);
+
+  return (long) ctx->rows * w;
+}
+
+/*
+ * A table of numbers filling the screen, formatted every frame.
+ */
+long
+bench_printf (conge_ctx* ctx, int frame)
+{
+  int x, y;
+
+  for (y = 0; y < ctx->rows; y++)
+    for (x = 0; x + 40 <= ctx->cols; x += 40)
+      conge_printf (ctx, x, y, CONGE_WHITE, CONGE_BLACK,
+                    "%-8s%6d %08x %10.3f ", "row", y * frame + x,
+                    (unsigned int) (frame * 2654435761u), frame / 7.0 + y);
+
+  return (long) ctx->rows * (ctx->cols / 40 * 40);
+}
+
+/*
+ * Sprites moving over the dashboard, all drawn every frame.
+ */
+long
+bench_widgets_sprites (conge_ctx* ctx, int frame)
+{
+  bench_widgets (ctx, NULL);
+  return bench_sprites (ctx, frame);
+}
+
+/*
+ * The same, with the dashboard drawn once into a layer of its own, and the
+ * sprites into another one above it.
+ */
+long
+bench_layers (conge_ctx* ctx, int frame)
+{
+  static conge_layer *background, *world;
+
+  /* Each screen size gets a new context, which frees the old layers. */
+  if (frame == 0)
+    {
+      background = conge_layer_new (ctx, 0);
+      world = conge_layer_new (ctx, 1);
+
+      conge_draw_into (ctx, background);
+      bench_widgets (ctx, NULL);
+    }
+
+  conge_clear_layer (ctx, world);
+  conge_draw_into (ctx, world);
+  return bench_sprites (ctx, frame);
+}
+
+/*
+ * Count the output instead of interpreting it like the headless screen.
+ */
+int
+bench_write (conge_ctx* ctx, const char* data, int length)
+{
+  return length;
+}
+
+/*
+ * Measure drawing WORKLOAD, then presenting it, on a COLS by ROWS screen in
+ * FORMAT, with SUBPIXELS. Command buffers are rasterized with THREADS
+ * threads.
+ */
+void
+bench_frames (const char* name, bench_workload workload, int cols, int rows,
+              int threads, int format, int subpixels)
+{
+  const char* modes[] = { "none", "half_block", "braille" };
+
+  conge_ctx* ctx = conge_init_headless (cols, rows);
+  conge_backend backend;
+
+  double raster = 0.0, present = 0.0;
+  long cells = 0, bytes = 0, writes = 0;
+  int frame, frames = 0;
+
+  if (ctx == NULL)
+    return;
+
+  backend = *ctx->_backend;
+  backend.write = bench_write;
+  ctx->_backend = &backend;
+
+  conge_set_threads (ctx, threads);
+  conge_set_format (ctx, format);
+  conge_set_subpixels (ctx, subpixels);
+
+  /* Don't measure the initial full redraw. */
+  ctx->_backend->get_window_size (ctx);
+  conge_prepare_frame (ctx);
+  workload (ctx, 0);
+  conge_draw_frame (ctx);
+
+  for (frame = 1; raster + present < BENCH_DURATION; frame++)
+    {
+      double start, drawn, presented;
+
+      conge_prepare_frame (ctx);
+
+      start = bench_now ();
+      cells += workload (ctx, frame);
+      drawn = bench_now ();
+      conge_draw_frame (ctx);
+      presented = bench_now ();
+
+      raster += drawn - start;
+      present += presented - drawn;
+
+      bytes += ctx->frame_bytes;
+      writes += ctx->frame_writes;
+      frames++;
+    }
+
+  printf ("{\"label\": \"%s\", \"bench\": \"frame\", \"workload\": \"%s\", "
+          "\"format\": \"%s\", \"cols\": %d, \"rows\": %d, "
+          "\"subpixels\": \"%s\", \"threads\": %d, \"frames\": %d, "
+          "\"cells_per_frame\": %ld, \"raster_ns_per_cell\": %.3f, "
+          "\"raster_cells_per_s\": %.0f, \"present_ns_per_cell\": %.3f, "
+          "\"present_cells_per_s\": %.0f, \"frame_us\": %.2f, "
+          "\"bytes_per_frame\": %ld, \"writes_per_frame\": %ld}\n",
+          bench_label, name,
+          format == CONGE_FORMAT_WIDE ? "wide" : "narrow", cols, rows,
+          modes[subpixels], threads, frames, cells / frames,
+          1e9 * raster / cells, cells / raster,
+          1e9 * present / ((double) frames * cols * rows),
+          (double) frames * cols * rows / present,
+          1e6 * (raster + present) / frames, bytes / frames, writes / frames);
+
+  conge_free (ctx);
+}
+
+/*
+ * Measure the rasterizers drawing SHAPE, "triangles", "lines" or "rects",
+ * into a COLS by ROWS canvas in FORMAT, with no context around.
+ */
+void
+bench_canvas (const char* shape, int cols, int rows, int format)
+{
+  conge_canvas* canvas = conge_canvas_new (cols, rows, format);
+  conge_pixel fill = conge_new_pixel ('*', CONGE_BRIGHT_GREEN, CONGE_BLACK);
+
+  double start, elapsed;
+  long cells = 0;
+  int frames = 0, i;
+
+  if (canvas == NULL)
+    return;
+
+  start = bench_now ();
+
+  do
+    {
+      bench_seed = frames + 1;
+
+      for (i = 0; i < 500; i++)
+        {
+          int x = bench_random (cols), y = bench_random (rows);
+          int w = 1 + bench_random (12), h = 1 + bench_random (8);
+
+          if (strcmp (shape, "triangles") == 0)
+            {
+              conge_canvas_triangle (canvas, x, y + h, x + w, y + h,
+                                     x + w / 2, y, fill);
+              cells += w * h / 2;
+            }
+          else if (strcmp (shape, "lines") == 0)
+            {
+              conge_canvas_line (canvas, x, y, x + 4 * w, y + h, fill);
+              cells += 4 * w + 1;
+            }
+          else
+            {
+              conge_canvas_rect (canvas, x, y, w, h, fill);
+              cells += w * h;
+            }
+        }
+
+      frames++;
+      elapsed = bench_now () - start;
+    }
+  while (elapsed < BENCH_DURATION);
+
+  printf ("{\"label\": \"%s\", \"bench\": \"canvas\", \"shape\": \"%s\", "
+          "\"format\": \"%s\", \"cols\": %d, \"rows\": %d, "
+          "\"ns_per_cell\": %.3f, \"cells_per_s\": %.0f}\n",
+          bench_label, shape,
+          format == CONGE_FORMAT_WIDE ? "wide" : "narrow", cols, rows,
+          1e9 * elapsed / cells, cells / elapsed);
+
+  conge_canvas_free (canvas);
+}
+
+/*
+ * Measure whole frames of WORKLOAD on a COLS by ROWS screen, presented from
+ * a swap chain of SWAPS buffers.
+ */
+void
+bench_pipeline (const char* name, bench_workload workload, int cols, int rows,
+                int swaps)
+{
+  conge_ctx* ctx = conge_init_headless (cols, rows);
+  conge_backend backend;
+
+  double start, elapsed = 0.0;
+  int frame, frames = 0;
+
+  if (ctx == NULL)
+    return;
+
+  backend = *ctx->_backend;
+  backend.write = bench_write;
+  ctx->_backend = &backend;
+
+  if (conge_set_swap_chain (ctx, swaps))
+    {
+      conge_free (ctx);
+      return;
+    }
+
+  /* Don't measure the initial full redraw. */
+  ctx->_backend->get_window_size (ctx);
+  conge_prepare_frame (ctx);
+  workload (ctx, 0);
+  conge_draw_frame (ctx);
+  conge_finish_presenting (ctx);
+
+  start = bench_now ();
+
+  for (frame = 1; elapsed < BENCH_DURATION; frame++)
+    {
+      conge_prepare_frame (ctx);
+      workload (ctx, frame);
+      conge_draw_frame (ctx);
+
+      elapsed = bench_now () - start;
+      frames++;
+    }
+
+  /* The frames still in flight count as well. */
+  conge_finish_presenting (ctx);
+  elapsed = bench_now () - start;
+
+  printf ("{\"label\": \"%s\", \"bench\": \"pipeline\", "
+          "\"workload\": \"%s\", \"cols\": %d, \"rows\": %d, "
+          "\"swaps\": %d, \"frames\": %d, \"frame_us\": %.2f, "
+          "\"frames_per_s\": %.0f}\n",
+          bench_label, name, cols, rows, swaps, frames,
+          1e6 * elapsed / frames, frames / elapsed);
+
+  conge_free (ctx);
+}
+
+int
+main (int argc, char** argv)
+{
+  double changed[] = { 0.0, 0.01, 0.1, 1.0 };
+  int sizes[][2] = { { 80, 25 }, { 160, 50 }, { 240, 80 }, { 400, 120 } };
+
+  const char* names[] = { "sprites", "fill", "lines", "triangles", "text",
+                          "static_text", "widgets", "widgets_cmdbuf",
+                          "tiles_fill", "tilemap", "widgets_sprites",
+                          "layers", "widgets_canvas",
+                          "widgets_viewports", "log", "printf" };
+  bench_workload workloads[] = { bench_sprites, bench_fill, bench_lines,
+                                 bench_triangles, bench_text,
+                                 bench_static_text, bench_widgets_direct,
+                                 bench_widgets_cmdbuf, bench_tiles_fill,
+                                 bench_tilemap, bench_widgets_sprites,
+                                 bench_layers, bench_widgets_canvas,
+                                 bench_widgets_viewports, bench_log,
+                                 bench_printf };
+  int count = sizeof (workloads) / sizeof (*workloads);
+
+  int i, j;
+
+  if (argc > 1)
+    bench_label = argv[1];
+
+  for (i = 0; i < 4; i++)
+    bench_diff (240, 80, changed[i]);
+
+  for (i = CONGE_FORMAT_NARROW; i <= CONGE_FORMAT_WIDE; i++)
+    {
+      bench_canvas ("triangles", 240, 80, i);
+      bench_canvas ("lines", 240, 80, i);
+      bench_canvas ("rects", 240, 80, i);
+    }
+
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < count; j++)
+      bench_frames (names[j], workloads[j], sizes[i][0], sizes[i][1], 1,
+                    CONGE_FORMAT_NARROW, CONGE_SUBPIXELS_NONE);
+
+  /* How replaying the command buffer scales with threads. */
+  for (i = 2; i < 4; i++)
+    for (j = 2; j <= 8; j *= 2)
+      bench_frames ("widgets_cmdbuf", bench_widgets_cmdbuf,
+                    sizes[i][0], sizes[i][1], j, CONGE_FORMAT_NARROW,
+                    CONGE_SUBPIXELS_NONE);
+
+  /* What the wide format costs, and true colors on top of that. */
+  for (i = 2; i < 4; i++)
+    {
+      for (j = 0; j < count; j++)
+        bench_frames (names[j], workloads[j], sizes[i][0], sizes[i][1], 1,
+                      CONGE_FORMAT_WIDE, CONGE_SUBPIXELS_NONE);
+
+      bench_frames ("gradient", bench_gradient, sizes[i][0], sizes[i][1], 1,
+                    CONGE_FORMAT_WIDE, CONGE_SUBPIXELS_NONE);
+
+      for (j = CONGE_SUBPIXELS_HALF_BLOCK; j <= CONGE_SUBPIXELS_BRAILLE; j++)
+        {
+          bench_frames ("subpixel_lines", bench_subpixel_lines,
+                        sizes[i][0], sizes[i][1], 1, CONGE_FORMAT_WIDE, j);
+          bench_frames ("subpixel_triangles", bench_subpixel_triangles,
+                        sizes[i][0], sizes[i][1], 1, CONGE_FORMAT_WIDE, j);
+        }
+    }
+
+  /* How much presenting on a thread of its own hides. */
+  for (i = 2; i < 4; i++)
+    for (j = 1; j <= CONGE_MAX_SWAPS; j++)
+      {
+        bench_pipeline ("sprites", bench_sprites, sizes[i][0], sizes[i][1], j);
+        bench_pipeline ("widgets", bench_widgets_direct,
+                        sizes[i][0], sizes[i][1], j);
+      }
+
+  return 0;
+}
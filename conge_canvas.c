@@ -0,0 +1,400 @@
+/* Canvases: pixels drawn into off the screen. */
+
+#include "conge.h"
+
+conge_canvas*
+conge_canvas_new (int w, int h, int format)
+{
+  conge_canvas* canvas;
+  size_t size;
+
+  if (w < 1 || h < 1)
+    return NULL;
+
+  if (format != CONGE_FORMAT_NARROW && format != CONGE_FORMAT_WIDE)
+    return NULL;
+
+  /* The pixels follow the canvas in the same block. */
+  size = (size_t) w * h * (format == CONGE_FORMAT_WIDE
+                           ? sizeof (conge_wide_pixel)
+                           : sizeof (conge_pixel));
+  canvas = malloc (sizeof (*canvas) + size);
+
+  if (canvas == NULL)
+    return NULL;
+
+  canvas->pixels = format == CONGE_FORMAT_WIDE ? NULL
+    : (conge_pixel*) (canvas + 1);
+  canvas->wide = format == CONGE_FORMAT_WIDE
+    ? (conge_wide_pixel*) (canvas + 1) : NULL;
+  canvas->w = w;
+  canvas->h = h;
+  canvas->stride = w;
+  canvas->key = 0;
+
+  conge_canvas_clip (canvas, 0, 0, w, h);
+  memset (canvas + 1, 0, size);
+
+  return canvas;
+}
+
+void
+conge_canvas_free (conge_canvas* canvas)
+{
+  free (canvas);
+}
+
+int
+conge_canvas_clip (conge_canvas* canvas, int x, int y, int w, int h)
+{
+  if (canvas == NULL)
+    return 1;
+
+  canvas->clip_x0 = CONGE_MAX (x, 0);
+  canvas->clip_y0 = CONGE_MAX (y, 0);
+  canvas->clip_x1 = CONGE_MIN ((long long) x + w - 1, canvas->w - 1);
+  canvas->clip_y1 = CONGE_MIN ((long long) y + h - 1, canvas->h - 1);
+
+  return 0;
+}
+
+int
+conge_canvas_target (const conge_canvas* canvas, conge_target* target)
+{
+  target->pixels = canvas->pixels;
+  target->wide = canvas->wide;
+  target->colors = NULL;
+  target->stride = canvas->stride;
+
+  /* The fields might have been set by hand. */
+  target->clip_x0 = CONGE_MAX (canvas->clip_x0, 0);
+  target->clip_y0 = CONGE_MAX (canvas->clip_y0, 0);
+  target->clip_x1 = CONGE_MIN (canvas->clip_x1, canvas->w - 1);
+  target->clip_y1 = CONGE_MIN (canvas->clip_y1, canvas->h - 1);
+
+  /* Canvases aren't shown, so they don't need to know what changed. */
+  target->dirty = NULL;
+
+  return target->clip_x0 > target->clip_x1
+    || target->clip_y0 > target->clip_y1;
+}
+
+int
+conge_canvas_clear (conge_canvas* canvas)
+{
+  conge_target target;
+  int y, count;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  count = target.clip_x1 - target.clip_x0 + 1;
+
+  for (y = target.clip_y0; y <= target.clip_y1; y++)
+    {
+      long offset = (long) target.stride * y + target.clip_x0;
+
+      if (target.wide != NULL)
+        memset (&target.wide[offset], 0, count * sizeof (*target.wide));
+      else
+        memset (&target.pixels[offset], 0, count * sizeof (*target.pixels));
+    }
+
+  return 0;
+}
+
+int
+conge_canvas_fill (conge_canvas* canvas, int x, int y, conge_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_span (&target, y, x, x, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_line (conge_canvas* canvas, int x0, int y0, int x1, int y1,
+                   conge_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_line (&target, x0, y0, x1, y1, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_triangle (conge_canvas* canvas, int x0, int y0, int x1, int y1,
+                       int x2, int y2, conge_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_triangle (&target, x0, y0, x1, y1, x2, y2, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_rect (conge_canvas* canvas, int x, int y, int w, int h,
+                   conge_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_rect (&target, x, y, w, h, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_string (conge_canvas* canvas, const char* string, int x, int y,
+                     int fg, int bg)
+{
+  conge_target target;
+  int length;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (string == NULL)
+    return 2;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  /* The string is only read as far as it can be seen. */
+  length = conge_string_length (string, (long long) target.clip_x1 + 1 - x);
+  conge_raster_string (&target, string, length, x, y, fg, bg);
+
+  return 0;
+}
+
+int
+conge_canvas_fill_wide (conge_canvas* canvas, int x, int y,
+                        conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_span (&target, y, x, x, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_line_wide (conge_canvas* canvas, int x0, int y0, int x1, int y1,
+                        conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_line (&target, x0, y0, x1, y1, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_triangle_wide (conge_canvas* canvas, int x0, int y0,
+                            int x1, int y1, int x2, int y2,
+                            conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_triangle (&target, x0, y0, x1, y1, x2, y2, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_rect_wide (conge_canvas* canvas, int x, int y, int w, int h,
+                        conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_rect (&target, x, y, w, h, &cell);
+
+  return 0;
+}
+
+int
+conge_canvas_string_wide (conge_canvas* canvas, const char* string,
+                          int x, int y, unsigned int fg, unsigned int bg)
+{
+  conge_target target;
+  int length;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (string == NULL)
+    return 2;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  /* A column takes up to 4 bytes of UTF-8. */
+  length = conge_string_length (string,
+                                4 * ((long long) target.clip_x1 + 1 - x));
+  conge_raster_wide_string (&target, string, length, x, y, fg, bg);
+
+  return 0;
+}
+
+int
+conge_canvas_blit (conge_canvas* canvas, const conge_sprite* sprite,
+                   int x, int y, int flags)
+{
+  conge_target target, source;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (sprite == NULL)
+    return 2;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_sprite_target (sprite, &source);
+  conge_raster_blit (&target, &source, sprite->key, 0, 0, sprite->w,
+                     sprite->h, x, y, flags);
+
+  return 0;
+}
+
+int
+conge_canvas_tilemap (conge_canvas* canvas, const conge_sprite* atlas,
+                      int tile_w, int tile_h, const int* tiles,
+                      int cols, int rows, int x, int y)
+{
+  conge_target target;
+
+  if (canvas == NULL)
+    return 1;
+
+  if (atlas == NULL || tiles == NULL)
+    return 2;
+
+  if (tile_w < 1 || tile_h < 1 || tile_w > atlas->w || tile_h > atlas->h)
+    return 3;
+
+  if (conge_canvas_target (canvas, &target))
+    return 0;
+
+  conge_raster_tilemap (&target, atlas, tile_w, tile_h, tiles, cols, rows,
+                        x, y);
+
+  return 0;
+}
+
+int
+conge_blit_canvas (conge_ctx* ctx, const conge_canvas* canvas, int x, int y,
+                   int flags)
+{
+  conge_target target, source;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (canvas == NULL)
+    return 2;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  /* Only the source's pixels are read, whatever its clip rectangle. */
+  conge_canvas_target (canvas, &source);
+  conge_raster_blit (&target, &source, canvas->key, 0, 0, canvas->w,
+                     canvas->h, conge_translate (x, dx),
+                     conge_translate (y, dy), flags);
+
+  return 0;
+}
+
+int
+conge_canvas_blit_canvas (conge_canvas* to, const conge_canvas* from,
+                          int x, int y, int flags)
+{
+  conge_target target, source;
+
+  if (to == NULL)
+    return 1;
+
+  if (from == NULL)
+    return 2;
+
+  if (conge_canvas_target (to, &target))
+    return 0;
+
+  conge_canvas_target (from, &source);
+  conge_raster_blit (&target, &source, from->key, 0, 0, from->w, from->h,
+                     x, y, flags);
+
+  return 0;
+}
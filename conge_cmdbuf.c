@@ -0,0 +1,497 @@
+/* Command buffers: drawing calls recorded now and executed band by band. */
+
+#include "conge.h"
+
+/* The height of the bands of rows the commands are sorted into. */
+#define CONGE__BAND_ROWS 16
+
+enum
+  {
+    CONGE__COMMAND_FILL,
+    CONGE__COMMAND_LINE,
+    CONGE__COMMAND_TRIANGLE,
+    CONGE__COMMAND_RECT,
+    CONGE__COMMAND_STRING,
+  };
+
+typedef struct conge_command conge_command;
+struct conge_command
+{
+  int type;
+  int x0, y0, x1, y1, x2, y2; /* the rectangle's size goes in X1 and Y1 */
+  conge_pixel fill;
+  int fg, bg;
+  int text, length; /* where the string is in the buffer's text */
+  int left, top, right, bottom; /* the bounding box, inclusive */
+};
+
+struct conge_cmdbuf
+{
+  conge_command* commands;
+  int count, capacity;
+  char* text; /* the recorded strings, one after another */
+  int text_length, text_capacity;
+  int* bins; /* the commands touching each band, band after band */
+  int bin_capacity;
+  int* band_starts; /* where each band begins in BINS, and where it ends */
+  int band_capacity;
+  int binned; /* set if the bins match the commands and the screen size */
+  int binned_cols, binned_rows;
+};
+
+/*
+ * Make room for NEEDED elements of SIZE bytes in *ARRAY. Return 1 if out of
+ * memory.
+ */
+int
+conge_grow (void** array, int* capacity, int needed, int size)
+{
+  int new_capacity = CONGE_MAX (16, *capacity);
+  void* grown;
+
+  if (needed <= *capacity)
+    return 0;
+
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  if (*array == NULL)
+    grown = malloc ((size_t) new_capacity * size);
+  else
+    grown = realloc (*array, (size_t) new_capacity * size);
+
+  if (grown == NULL)
+    return 1;
+
+  *array = grown;
+  *capacity = new_capacity;
+
+  return 0;
+}
+
+conge_cmdbuf*
+conge_cmdbuf_new (void)
+{
+  conge_cmdbuf* cmdbuf = malloc (sizeof (*cmdbuf));
+
+  if (cmdbuf == NULL)
+    return NULL;
+
+  cmdbuf->commands = NULL;
+  cmdbuf->count = 0;
+  cmdbuf->capacity = 0;
+
+  cmdbuf->text = NULL;
+  cmdbuf->text_length = 0;
+  cmdbuf->text_capacity = 0;
+
+  cmdbuf->bins = NULL;
+  cmdbuf->bin_capacity = 0;
+  cmdbuf->band_starts = NULL;
+  cmdbuf->band_capacity = 0;
+
+  cmdbuf->binned = 0;
+
+  return cmdbuf;
+}
+
+void
+conge_cmdbuf_free (conge_cmdbuf* cmdbuf)
+{
+  if (cmdbuf != NULL)
+    {
+      free (cmdbuf->commands);
+      free (cmdbuf->text);
+      free (cmdbuf->bins);
+      free (cmdbuf->band_starts);
+      free (cmdbuf);
+    }
+}
+
+void
+conge_cmdbuf_clear (conge_cmdbuf* cmdbuf)
+{
+  if (cmdbuf != NULL)
+    {
+      cmdbuf->count = 0;
+      cmdbuf->text_length = 0;
+      cmdbuf->binned = 0;
+    }
+}
+
+/*
+ * Append a command of TYPE covering the columns LEFT to RIGHT of the rows
+ * TOP to BOTTOM. Return null if out of memory.
+ */
+conge_command*
+conge_record (conge_cmdbuf* cmdbuf, int type, long long left, long long top,
+              long long right, long long bottom)
+{
+  conge_command* command;
+
+  if (conge_grow ((void**) &cmdbuf->commands, &cmdbuf->capacity,
+                  cmdbuf->count + 1, sizeof (*cmdbuf->commands)))
+    return NULL;
+
+  command = &cmdbuf->commands[cmdbuf->count++];
+  command->type = type;
+
+  /* The bounds only need to reach past the screen. */
+  command->left = CONGE_MAX (left, -1);
+  command->top = CONGE_MAX (top, -1);
+  command->right = CONGE_MIN (right, 0x7FFFFFFF);
+  command->bottom = CONGE_MIN (bottom, 0x7FFFFFFF);
+
+  cmdbuf->binned = 0;
+
+  return command;
+}
+
+int
+conge_cmdbuf_fill (conge_cmdbuf* cmdbuf, int x, int y, conge_pixel fill)
+{
+  conge_command* command;
+
+  if (cmdbuf == NULL)
+    return 1;
+
+  command = conge_record (cmdbuf, CONGE__COMMAND_FILL, x, y, x, y);
+
+  if (command == NULL)
+    return 3;
+
+  command->x0 = x;
+  command->y0 = y;
+  command->fill = fill;
+
+  return 0;
+}
+
+int
+conge_cmdbuf_line (conge_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1,
+                   conge_pixel fill)
+{
+  conge_command* command;
+
+  if (cmdbuf == NULL)
+    return 1;
+
+  command = conge_record (cmdbuf, CONGE__COMMAND_LINE,
+                          CONGE_MIN (x0, x1), CONGE_MIN (y0, y1),
+                          CONGE_MAX (x0, x1), CONGE_MAX (y0, y1));
+
+  if (command == NULL)
+    return 3;
+
+  command->x0 = x0;
+  command->y0 = y0;
+  command->x1 = x1;
+  command->y1 = y1;
+  command->fill = fill;
+
+  return 0;
+}
+
+int
+conge_cmdbuf_triangle (conge_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1,
+                       int x2, int y2, conge_pixel fill)
+{
+  conge_command* command;
+
+  if (cmdbuf == NULL)
+    return 1;
+
+  command = conge_record (cmdbuf, CONGE__COMMAND_TRIANGLE,
+                          CONGE_MIN (x0, CONGE_MIN (x1, x2)),
+                          CONGE_MIN (y0, CONGE_MIN (y1, y2)),
+                          CONGE_MAX (x0, CONGE_MAX (x1, x2)),
+                          CONGE_MAX (y0, CONGE_MAX (y1, y2)));
+
+  if (command == NULL)
+    return 3;
+
+  command->x0 = x0;
+  command->y0 = y0;
+  command->x1 = x1;
+  command->y1 = y1;
+  command->x2 = x2;
+  command->y2 = y2;
+  command->fill = fill;
+
+  return 0;
+}
+
+int
+conge_cmdbuf_rect (conge_cmdbuf* cmdbuf, int x, int y, int w, int h,
+                   conge_pixel fill)
+{
+  conge_command* command;
+
+  if (cmdbuf == NULL)
+    return 1;
+
+  command = conge_record (cmdbuf, CONGE__COMMAND_RECT, x, y,
+                          (long long) x + w - 1, (long long) y + h - 1);
+
+  if (command == NULL)
+    return 3;
+
+  command->x0 = x;
+  command->y0 = y;
+  command->x1 = w;
+  command->y1 = h;
+  command->fill = fill;
+
+  return 0;
+}
+
+int
+conge_cmdbuf_string (conge_cmdbuf* cmdbuf, const char* string, int x, int y,
+                     int fg, int bg)
+{
+  conge_command* command;
+  int length;
+
+  if (cmdbuf == NULL)
+    return 1;
+
+  if (string == NULL)
+    return 2;
+
+  length = strlen (string);
+
+  if (conge_grow ((void**) &cmdbuf->text, &cmdbuf->text_capacity,
+                  cmdbuf->text_length + length, 1))
+    return 3;
+
+  command = conge_record (cmdbuf, CONGE__COMMAND_STRING,
+                          x, y, (long long) x + length - 1, y);
+
+  if (command == NULL)
+    return 3;
+
+  if (length > 0)
+    memcpy (cmdbuf->text + cmdbuf->text_length, string, length);
+
+  command->x0 = x;
+  command->y0 = y;
+  command->fill = 0;
+  command->fg = fg;
+  command->bg = bg;
+  command->text = cmdbuf->text_length;
+  command->length = length;
+
+  cmdbuf->text_length += length;
+
+  return 0;
+}
+
+/*
+ * Sort the commands into the bands of a COLS by ROWS screen, keeping their
+ * order within each band. Return 1 if out of memory.
+ */
+int
+conge_bin_commands (conge_cmdbuf* cmdbuf, int cols, int rows)
+{
+  int bands = (rows + CONGE__BAND_ROWS - 1) / CONGE__BAND_ROWS;
+  int* starts;
+  int i, band;
+
+  /* Replaying the same commands on the same screen reuses the bins. */
+  if (cmdbuf->binned && cmdbuf->binned_cols == cols
+      && cmdbuf->binned_rows == rows)
+    return 0;
+
+  if (conge_grow ((void**) &cmdbuf->band_starts, &cmdbuf->band_capacity,
+                  bands + 1, sizeof (*cmdbuf->band_starts)))
+    return 1;
+
+  starts = cmdbuf->band_starts;
+
+  for (band = 0; band <= bands; band++)
+    starts[band] = 0;
+
+  /* Count the commands of each band... */
+  for (i = 0; i < cmdbuf->count; i++)
+    {
+      conge_command* command = &cmdbuf->commands[i];
+      int top = CONGE_MAX (command->top, 0);
+      int bottom = CONGE_MIN (command->bottom, rows - 1);
+
+      if (command->right < 0 || command->left >= cols || top > bottom)
+        continue;
+
+      for (band = top / CONGE__BAND_ROWS;
+           band <= bottom / CONGE__BAND_ROWS; band++)
+        starts[band + 1]++;
+    }
+
+  for (band = 0; band < bands; band++)
+    starts[band + 1] += starts[band];
+
+  if (conge_grow ((void**) &cmdbuf->bins, &cmdbuf->bin_capacity,
+                  starts[bands], sizeof (*cmdbuf->bins)))
+    return 1;
+
+  /* ...then put them in place, moving each band's start to its end... */
+  for (i = 0; i < cmdbuf->count; i++)
+    {
+      conge_command* command = &cmdbuf->commands[i];
+      int top = CONGE_MAX (command->top, 0);
+      int bottom = CONGE_MIN (command->bottom, rows - 1);
+
+      if (command->right < 0 || command->left >= cols || top > bottom)
+        continue;
+
+      for (band = top / CONGE__BAND_ROWS;
+           band <= bottom / CONGE__BAND_ROWS; band++)
+        cmdbuf->bins[starts[band]++] = i;
+    }
+
+  /* ...which is the next band's start. */
+  for (band = bands; band > 0; band--)
+    starts[band] = starts[band - 1];
+
+  starts[0] = 0;
+
+  cmdbuf->binned = 1;
+  cmdbuf->binned_cols = cols;
+  cmdbuf->binned_rows = rows;
+
+  return 0;
+}
+
+/*
+ * Execute COMMAND within TARGET's clip rectangle.
+ */
+void
+conge_execute_command (const conge_target* target, const conge_cmdbuf* cmdbuf,
+                       const conge_command* command)
+{
+  conge_cell cell;
+
+  /* The commands are recorded narrow, whatever the frame is. */
+  conge_narrow_cell (target, command->fill, &cell);
+
+  switch (command->type)
+    {
+    case CONGE__COMMAND_FILL:
+      conge_raster_span (target, command->y0, command->x0, command->x0,
+                         &cell);
+      break;
+    case CONGE__COMMAND_LINE:
+      conge_raster_line (target, command->x0, command->y0,
+                         command->x1, command->y1, &cell);
+      break;
+    case CONGE__COMMAND_TRIANGLE:
+      conge_raster_triangle (target, command->x0, command->y0,
+                             command->x1, command->y1,
+                             command->x2, command->y2, &cell);
+      break;
+    case CONGE__COMMAND_RECT:
+      conge_raster_rect (target, command->x0, command->y0,
+                         command->x1, command->y1, &cell);
+      break;
+    case CONGE__COMMAND_STRING:
+      conge_raster_string (target, cmdbuf->text + command->text,
+                           command->length, command->x0, command->y0,
+                           command->fg, command->bg);
+      break;
+    }
+}
+
+/*
+ * Execute the commands of BAND, clipped to it.
+ */
+void
+conge_execute_band (conge_ctx* ctx, const conge_cmdbuf* cmdbuf, int band)
+{
+  conge_target target;
+  int i;
+
+  conge_frame_target (ctx, &target);
+
+  target.clip_y0 = band * CONGE__BAND_ROWS;
+  target.clip_y1 = CONGE_MIN (target.clip_y0 + CONGE__BAND_ROWS,
+                              ctx->rows) - 1;
+
+  for (i = cmdbuf->band_starts[band]; i < cmdbuf->band_starts[band + 1]; i++)
+    conge_execute_command (&target, cmdbuf,
+                           &cmdbuf->commands[cmdbuf->bins[i]]);
+}
+
+/* What the pool's threads need to execute the bands. */
+typedef struct conge_submission conge_submission;
+struct conge_submission
+{
+  conge_ctx* ctx;
+  const conge_cmdbuf* cmdbuf;
+};
+
+void
+conge_execute_band_job (void* data, int band)
+{
+  conge_submission* submission = data;
+
+  conge_execute_band (submission->ctx, submission->cmdbuf, band);
+}
+
+int
+conge_cmdbuf_submit (conge_ctx* ctx, conge_cmdbuf* cmdbuf)
+{
+  int band, bands;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (cmdbuf == NULL)
+    return 2;
+
+  if (conge_bin_commands (cmdbuf, ctx->cols, ctx->rows))
+    return 3;
+
+  bands = (ctx->rows + CONGE__BAND_ROWS - 1) / CONGE__BAND_ROWS;
+
+  /* The bands share no pixels, nor dirty spans. */
+  if (ctx->_pool != NULL && bands > 1)
+    {
+      conge_submission submission;
+
+      submission.ctx = ctx;
+      submission.cmdbuf = cmdbuf;
+
+      conge_pool_run (ctx->_pool, conge_execute_band_job, &submission, bands);
+      return 0;
+    }
+
+  for (band = 0; band < bands; band++)
+    conge_execute_band (ctx, cmdbuf, band);
+
+  return 0;
+}
+
+int
+conge_set_threads (conge_ctx* ctx, int threads)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (threads < 0)
+    return 2;
+
+  if (threads == 0)
+    threads = conge_cpu_count ();
+
+  conge_pool_free (ctx->_pool);
+  ctx->_pool = NULL;
+
+  if (threads > 1)
+    {
+      ctx->_pool = conge_pool_new (threads);
+
+      if (ctx->_pool == NULL)
+        return 3;
+    }
+
+  return 0;
+}
@@ -2,4 +2,20 @@
 
 #include "conge.c"
 #include "conge_graphics.c"
+#include "conge_raster.c"
+#include "conge_subpixel.c"
+#include "conge_sprite.c"
+#include "conge_layer.c"
+#include "conge_canvas.c"
+#include "conge_viewport.c"
+#include "conge_text.c"
+#include "conge_cmdbuf.c"
+#include "conge_thread.c"
+#include "conge_trace.c"
 #include "conge_input.c"
+#include "conge_output.c"
+#include "conge_present.c"
+#include "conge_simd.c"
+#include "conge_headless.c"
+#include "conge_posix.c"
+#include "conge_win32.c"
@@ -49,6 +49,112 @@ conge_set_bg (conge_pixel* pixel, int bg)
     *pixel = (conge_pixel) (bg << 12) | (*pixel & 0xFFF);
 }
 
+conge_wide_pixel
+conge_new_wide_pixel (unsigned int character, unsigned int fg,
+                      unsigned int bg)
+{
+  conge_wide_pixel pixel;
+
+  pixel.character = character;
+  pixel.fg = fg;
+  pixel.bg = bg;
+
+  return pixel;
+}
+
+conge_wide_pixel
+conge_widen_pixel (conge_pixel pixel)
+{
+  return conge_new_wide_pixel (conge_get_character (pixel),
+                               CONGE_PALETTE (conge_get_fg (pixel)),
+                               CONGE_PALETTE (conge_get_bg (pixel)));
+}
+
+/* The colors of the first 16 palette entries, in console order. */
+static const unsigned int conge_palette_rgb[16] =
+  {
+    0x000000, 0x000080, 0x008000, 0x008080,
+    0x800000, 0x800080, 0x808000, 0xC0C0C0,
+    0x808080, 0x0000FF, 0x00FF00, 0x00FFFF,
+    0xFF0000, 0xFF00FF, 0xFFFF00, 0xFFFFFF,
+  };
+
+/*
+ * Return the true color of a palette index past the first 16: a 6x6x6
+ * cube, then 24 shades of gray.
+ */
+unsigned int
+conge_palette_color (int index)
+{
+  static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+  int gray;
+
+  if (index >= 232)
+    {
+      gray = 8 + 10 * (index - 232);
+      return CONGE_RGB (gray, gray, gray);
+    }
+
+  index -= 16;
+
+  return CONGE_RGB (levels[index / 36], levels[index / 6 % 6],
+                    levels[index % 6]);
+}
+
+int
+conge_nearest_color (unsigned int color)
+{
+  int i, best = 0;
+  long best_distance = -1;
+
+  if (color & CONGE_PALETTE (0))
+    {
+      if ((color & 0xFF) < 16)
+        return color & 0xF;
+
+      color = conge_palette_color (color & 0xFF);
+    }
+
+  for (i = 0; i < 16; i++)
+    {
+      long dr = (long) ((color >> 16) & 0xFF)
+        - ((conge_palette_rgb[i] >> 16) & 0xFF);
+      long dg = (long) ((color >> 8) & 0xFF)
+        - ((conge_palette_rgb[i] >> 8) & 0xFF);
+      long db = (long) (color & 0xFF) - (conge_palette_rgb[i] & 0xFF);
+      long distance = dr * dr + dg * dg + db * db;
+
+      if (best_distance < 0 || distance < best_distance)
+        {
+          best = i;
+          best_distance = distance;
+        }
+    }
+
+  return best;
+}
+
+conge_pixel
+conge_narrow_pixel (conge_wide_pixel pixel)
+{
+  unsigned char character = pixel.character < 256 ? pixel.character : '?';
+
+  return conge_new_pixel (character, conge_nearest_color (pixel.fg),
+                          conge_nearest_color (pixel.bg));
+}
+
+void
+conge_mark_dirty (conge_ctx* ctx, int y, int x0, int x1)
+{
+  conge_span* span = &ctx->_dirty[y];
+
+  if (x0 < span->min)
+    span->min = x0;
+
+  if (x1 > span->max)
+    span->max = x1;
+}
+
 conge_pixel*
 conge_get_pixel (conge_ctx* ctx, int x, int y)
 {
@@ -56,22 +162,56 @@ conge_get_pixel (conge_ctx* ctx, int x, int y)
     return NULL;
   else if (x < 0 || y < 0 || x >= ctx->cols || y >= ctx->rows)
     return NULL;
+  else if (ctx->frame == NULL)
+    return NULL;
   else
-    return &ctx->frame[ctx->rows * x + y];
+    {
+      /* The pixel can be modified through the pointer. */
+      conge_mark_dirty (ctx, y, x, x);
+      return &ctx->frame[ctx->cols * y + x];
+    }
+}
+
+conge_wide_pixel*
+conge_get_wide_pixel (conge_ctx* ctx, int x, int y)
+{
+  if (ctx == NULL || ctx->wide_frame == NULL)
+    return NULL;
+  else if (x < 0 || y < 0 || x >= ctx->cols || y >= ctx->rows)
+    return NULL;
+  else
+    {
+      conge_mark_dirty (ctx, y, x, x);
+      return &ctx->wide_frame[ctx->cols * y + x];
+    }
+}
+
+void
+conge_invalidate (conge_ctx* ctx)
+{
+  int y;
+
+  if (ctx != NULL)
+    for (y = 0; y < ctx->rows; y++)
+      conge_mark_dirty (ctx, y, 0, ctx->cols - 1);
 }
 
 int
 conge_fill (conge_ctx* ctx, int x, int y, conge_pixel fill)
 {
   conge_pixel* pixel;
+  conge_wide_pixel* wide;
 
   if (ctx == NULL)
     return 1;
 
-  pixel = conge_get_pixel (ctx, x, y);
+  if (ctx->_viewport_count > 0 && conge_view_point (ctx, &x, &y))
+    return 0;
 
-  if (pixel != NULL)
+  if ((pixel = conge_get_pixel (ctx, x, y)) != NULL)
     *pixel = fill;
+  else if ((wide = conge_get_wide_pixel (ctx, x, y)) != NULL)
+    *wide = conge_widen_pixel (fill);
 
   return 0;
 }
@@ -79,67 +219,72 @@ conge_fill (conge_ctx* ctx, int x, int y, conge_pixel fill)
 int
 conge_draw_line (conge_ctx* ctx, int x0, int y0, int x1, int y1, conge_pixel fill)
 {
-  int i = 0;
-
-  double x = x0, y = y0;
-  double dx = x1 - x0, dy = y1 - y0;
-  double step = CONGE_MAX (fabs (dx), fabs (dy));
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
 
   if (ctx == NULL)
     return 1;
 
-  /* Special case: just a dot. Prevents division by zero. */
-  if (step <= 0.01)
-    {
-      conge_fill (ctx, x0, y0, fill);
-      return 0;
-    }
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
 
-  dx /= step;
-  dy /= step;
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
 
-  while (i++ < step)
-    {
-      conge_fill (ctx, round (x), round (y), fill);
-      x += dx;
-      y += dy;
-    }
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_line (&target, x0, y0, x1, y1, &cell);
 
   return 0;
 }
 
-/*
- * Check if point (x; y) is within the triangle edge (x0; y0)--(x1; y1).
- */
 int
-conge_check_edge (double x, double y, double x0, double y0, double x1, double y1)
+conge_fill_triangle (conge_ctx* ctx, int x0, int y0, int x1, int y1,
+                     int x2, int y2, conge_pixel fill)
 {
-  return (x - x0) * (y1 - y0) - (y - y0) * (x1 - x0) >= 0.0;
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
+  x2 = conge_translate (x2, dx);
+  y2 = conge_translate (y2, dy);
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_triangle (&target, x0, y0, x1, y1, x2, y2, &cell);
+
+  return 0;
 }
 
 int
-conge_fill_triangle (conge_ctx* ctx, int x0, int y0, int x1, int y1,
-                     int x2, int y2, conge_pixel fill)
+conge_fill_rect (conge_ctx* ctx, int x, int y, int w, int h, conge_pixel fill)
 {
-  int bx0, by0, bx1, by1; /* bounding box */
-  int x, y;
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
 
   if (ctx == NULL)
     return 1;
 
-  bx0 = CONGE_MIN (x0, CONGE_MIN (x1, x2));
-  by0 = CONGE_MIN (y0, CONGE_MIN (y1, y2));
-  bx1 = CONGE_MAX (x0, CONGE_MAX (x1, x2));
-  by1 = CONGE_MAX (y0, CONGE_MAX (y1, y2));
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
 
-  for (x = bx0; x <= bx1; x++)
-    for (y = by0; y <= by1; y++)
-      {
-        if (conge_check_edge (x, y, x0, y0, x1, y1)
-            && conge_check_edge (x, y, x1, y1, x2, y2)
-            && conge_check_edge (x, y, x2, y2, x0, y0))
-          conge_fill (ctx, x, y, fill);
-      }
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  conge_narrow_cell (&target, fill, &cell);
+  conge_raster_rect (&target, x, y, w, h, &cell);
 
   return 0;
 }
@@ -147,7 +292,8 @@ conge_fill_triangle (conge_ctx* ctx, int x0, int y0, int x1, int y1,
 int
 conge_write_string (conge_ctx* ctx, const char* string, int x, int y, int fg, int bg)
 {
-  int i, len;
+  conge_target target;
+  int dx, dy, length;
 
   if (ctx == NULL)
     return 1;
@@ -155,92 +301,144 @@ conge_write_string (conge_ctx* ctx, const char* string, int x, int y, int fg, in
   if (string == NULL)
     return 2;
 
-  len = strlen (string);
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
 
-  for (i = 0; i < len; i++)
-    {
-      int char_x = x + i;
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
 
-      if (char_x >= ctx->cols)
-        break;
-      else
-        {
-          conge_pixel* pixel = conge_get_pixel (ctx, char_x, y);
+  /* A row outside the viewport isn't worth reading the string for. */
+  if (y < target.clip_y0 || y > target.clip_y1)
+    return 0;
 
-          conge_set_character (pixel, string[i]);
-          conge_set_fg (pixel, fg);
-          conge_set_bg (pixel, bg);
-        }
-    }
+  /* The string is only read as far as it can be seen. */
+  length = conge_string_length (string, (long long) target.clip_x1 + 1 - x);
+  conge_raster_string (&target, string, length, x, y, fg, bg);
 
   return 0;
 }
 
-/*
- * Move the cursor unless putchar can do it.
- */
-void
-conge_move_cursor_to (conge_ctx* ctx, int x, int y)
+int
+conge_fill_wide (conge_ctx* ctx, int x, int y, conge_wide_pixel fill)
 {
-  /* Writing to stdout moves the cursor to the right anyways. */
-  if (ctx->_cursor_y != y || ctx->_cursor_x != x - 1)
-    {
-      COORD coord;
+  conge_pixel* pixel;
+  conge_wide_pixel* wide;
 
-      coord.X = x;
-      coord.Y = y;
+  if (ctx == NULL)
+    return 1;
 
-      SetConsoleCursorPosition (ctx->_output, coord);
-    }
+  if (ctx->_viewport_count > 0 && conge_view_point (ctx, &x, &y))
+    return 0;
 
-  ctx->_cursor_x = x;
-  ctx->_cursor_y = y;
+  if ((wide = conge_get_wide_pixel (ctx, x, y)) != NULL)
+    *wide = fill;
+  else if ((pixel = conge_get_pixel (ctx, x, y)) != NULL)
+    *pixel = conge_narrow_pixel (fill);
+
+  return 0;
 }
 
-/*
- * Print all subsequent characters in this color.
- */
-void
-conge_set_text_color (conge_ctx* ctx, int color)
+int
+conge_draw_line_wide (conge_ctx* ctx, int x0, int y0, int x1, int y1,
+                      conge_wide_pixel fill)
 {
-  if (ctx->_last_color != color)
-    {
-      SetConsoleTextAttribute (ctx->_output, color);
-      ctx->_last_color = color;
-    }
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_line (&target, x0, y0, x1, y1, &cell);
+
+  return 0;
 }
 
-void
-conge_draw_frame (conge_ctx* ctx)
-{
-  int x, y;
-
-  /* Trigger the initial cursor movement. */
-  ctx->_cursor_x = -2;
-  ctx->_cursor_y = 0;
-
-  /* Compare the front and back buffers. */
-  for (y = 0; y < ctx->rows; y++)
-    for (x = 0; x < ctx->cols; x++)
-      {
-        conge_pixel* front = conge_get_pixel (ctx, x, y);
-        conge_pixel* back = &ctx->_backbuffer[ctx->rows * x + y];
-
-        if (*front != *back)
-          {
-            char character = conge_get_character (*front);
-            int color = (16 * conge_get_bg (*front)) + conge_get_fg (*front);
-
-            /* Write the pixel at that position. */
-            conge_move_cursor_to (ctx, x, y);
-            conge_set_text_color (ctx, color);
-            write (1, &character, 1);
-
-            *back = *front;
-          }
-      }
-
-  /* Prevent visual glitches on exit. */
-  conge_move_cursor_to (ctx, 0, 0);
-  conge_set_text_color (ctx, CONGE_WHITE);
+int
+conge_fill_triangle_wide (conge_ctx* ctx, int x0, int y0, int x1, int y1,
+                          int x2, int y2, conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
+  x2 = conge_translate (x2, dx);
+  y2 = conge_translate (y2, dy);
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_triangle (&target, x0, y0, x1, y1, x2, y2, &cell);
+
+  return 0;
+}
+
+int
+conge_fill_rect_wide (conge_ctx* ctx, int x, int y, int w, int h,
+                      conge_wide_pixel fill)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  conge_wide_cell (&target, fill, &cell);
+  conge_raster_rect (&target, x, y, w, h, &cell);
+
+  return 0;
+}
+
+int
+conge_write_string_wide (conge_ctx* ctx, const char* string, int x, int y,
+                         unsigned int fg, unsigned int bg)
+{
+  conge_target target;
+  int dx, dy, length;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (string == NULL)
+    return 2;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  if (y < target.clip_y0 || y > target.clip_y1)
+    return 0;
+
+  /* A column takes up to 4 bytes of UTF-8. */
+  length = conge_string_length (string,
+                                4 * ((long long) target.clip_x1 + 1 - x));
+  conge_raster_wide_string (&target, string, length, x, y, fg, bg);
+
+  return 0;
 }
@@ -0,0 +1,622 @@
+/* The headless backend: a screen in memory, for tests and benchmarks. */
+
+#include "conge.h"
+
+/* The amount of events which can wait for the next frame. */
+#define CONGE__HEADLESS_EVENTS 256
+
+struct conge_headless
+{
+  int cols, rows; /* the screen size */
+  conge_wide_pixel* cells; /* what the screen shows, row by row */
+  int cursor_x, cursor_y;
+  int wrap; /* set if the next character goes to the next line */
+  unsigned int fg, bg; /* the colors of the next character */
+  int utf8; /* set if the bytes are UTF-8 rather than one per character */
+  char character[4]; /* a UTF-8 character cut off so far */
+  int character_length;
+  char sequence[160]; /* an escape sequence cut off by the last write */
+  int sequence_length;
+  char* output; /* the bytes written since the last read */
+  int output_length, output_capacity;
+  double time; /* the clock only advances while sleeping */
+  conge_event events[CONGE__HEADLESS_EVENTS]; /* waiting for the next frame */
+  int event_count;
+};
+
+/*
+ * Reset a cell to what a blank screen shows.
+ */
+void
+conge_headless_blank (conge_wide_pixel* cell)
+{
+  cell->character = ' ';
+  cell->fg = CONGE_PALETTE (CONGE_WHITE);
+  cell->bg = CONGE_PALETTE (CONGE_BLACK);
+}
+
+/*
+ * Move the cursor one line down, scrolling the screen at the bottom.
+ */
+void
+conge_headless_line_feed (conge_headless* headless)
+{
+  int i, area = headless->rows * headless->cols;
+
+  if (headless->cursor_y + 1 < headless->rows)
+    {
+      headless->cursor_y++;
+      return;
+    }
+
+  memmove (headless->cells, headless->cells + headless->cols,
+           (area - headless->cols) * sizeof (*headless->cells));
+
+  for (i = area - headless->cols; i < area; i++)
+    conge_headless_blank (&headless->cells[i]);
+}
+
+/*
+ * Print a character at the cursor, like a terminal with autowrap would.
+ */
+void
+conge_headless_print (conge_headless* headless, unsigned int character)
+{
+  conge_wide_pixel* cell;
+
+  if (headless->wrap)
+    {
+      headless->cursor_x = 0;
+      headless->wrap = 0;
+      conge_headless_line_feed (headless);
+    }
+
+  cell = &headless->cells[headless->cols * headless->cursor_y
+                          + headless->cursor_x];
+
+  cell->character = character;
+  cell->fg = headless->fg;
+  cell->bg = headless->bg;
+
+  if (headless->cursor_x + 1 < headless->cols)
+    headless->cursor_x++;
+  else
+    headless->wrap = 1;
+}
+
+/*
+ * Print the UTF-8 characters gathered so far. Bytes which don't make up a
+ * character stand for themselves, like Latin-1.
+ */
+void
+conge_headless_flush_character (conge_headless* headless)
+{
+  const char* character = headless->character;
+  const char* end = character + headless->character_length;
+
+  while (character < end)
+    {
+      unsigned int code;
+
+      character = conge_decode_utf8 (character, end, &code);
+      conge_headless_print (headless, code);
+    }
+
+  headless->character_length = 0;
+}
+
+/*
+ * Add a byte of a UTF-8 character, and print it once it's complete.
+ */
+void
+conge_headless_decode (conge_headless* headless, unsigned char byte)
+{
+  unsigned char lead;
+  int length;
+
+  /* A byte which can't continue the character starts another one. */
+  if (headless->character_length > 0 && (byte & 0xC0) != 0x80)
+    conge_headless_flush_character (headless);
+
+  headless->character[headless->character_length++] = byte;
+  lead = headless->character[0];
+
+  if (lead >= 0xC2 && lead <= 0xDF)
+    length = 2;
+  else if (lead >= 0xE0 && lead <= 0xEF)
+    length = 3;
+  else if (lead >= 0xF0 && lead <= 0xF4)
+    length = 4;
+  else
+    length = 1;
+
+  if (headless->character_length >= length)
+    conge_headless_flush_character (headless);
+}
+
+/*
+ * Read the color after a 38 or 48 SGR parameter at PARAMS[*I], moving *I
+ * past it. Return CONGE__NO_COLOR if it's malformed.
+ */
+unsigned int
+conge_headless_color (const int* params, int count, int* i)
+{
+  if (*i + 2 < count && params[*i + 1] == 5)
+    {
+      *i += 2;
+      return CONGE_PALETTE (params[*i] & 0xFF);
+    }
+
+  if (*i + 4 < count && params[*i + 1] == 2)
+    {
+      *i += 4;
+      return CONGE_RGB (params[*i - 2] & 0xFF, params[*i - 1] & 0xFF,
+                        params[*i] & 0xFF);
+    }
+
+  *i = count;
+  return CONGE__NO_COLOR;
+}
+
+/*
+ * Execute a complete CSI sequence, ignoring the ones ConGE doesn't send.
+ */
+void
+conge_headless_execute (conge_headless* headless, const char* sequence,
+                        int length)
+{
+  int params[16], count = 0, i, n;
+  char final = sequence[length - 1];
+
+  /* Private modes only affect the cursor's visibility and mouse reports. */
+  if (sequence[2] == '?')
+    return;
+
+  params[0] = 0;
+
+  for (i = 2; i < length - 1 && count < 16; i++)
+    {
+      if (sequence[i] == ';')
+        {
+          if (++count < 16)
+            params[count] = 0;
+        }
+      else
+        params[count] = 10 * params[count] + sequence[i] - '0';
+    }
+
+  count++;
+
+  /* Omitted or zero counts mean 1. */
+  n = params[0] > 0 ? params[0] : 1;
+
+  headless->wrap = 0;
+
+  switch (final)
+    {
+    case 'H':
+      headless->cursor_y = n - 1;
+      headless->cursor_x = count > 1 && params[1] > 0 ? params[1] - 1 : 0;
+      break;
+    case 'A':
+      headless->cursor_y -= n;
+      break;
+    case 'B':
+      headless->cursor_y += n;
+      break;
+    case 'C':
+      headless->cursor_x += n;
+      break;
+    case 'D':
+      headless->cursor_x -= n;
+      break;
+    case 'G':
+      headless->cursor_x = n - 1;
+      break;
+    case 'd':
+      headless->cursor_y = n - 1;
+      break;
+    case 'm':
+      for (i = 0; i < count; i++)
+        {
+          int param = params[i];
+          unsigned int color;
+
+          if (param == 0)
+            {
+              headless->fg = CONGE_PALETTE (CONGE_WHITE);
+              headless->bg = CONGE_PALETTE (CONGE_BLACK);
+            }
+          else if (param >= 30 && param <= 37)
+            headless->fg = CONGE_PALETTE (conge_vt_colors[param - 30]);
+          else if (param >= 90 && param <= 97)
+            headless->fg = CONGE_PALETTE (8 + conge_vt_colors[param - 90]);
+          else if (param >= 40 && param <= 47)
+            headless->bg = CONGE_PALETTE (conge_vt_colors[param - 40]);
+          else if (param >= 100 && param <= 107)
+            headless->bg = CONGE_PALETTE (8 + conge_vt_colors[param - 100]);
+          else if (param == 39)
+            headless->fg = CONGE_PALETTE (CONGE_WHITE);
+          else if (param == 49)
+            headless->bg = CONGE_PALETTE (CONGE_BLACK);
+          else if (param == 38 || param == 48)
+            {
+              color = conge_headless_color (params, count, &i);
+
+              if (color == CONGE__NO_COLOR)
+                break;
+
+              if (param == 38)
+                headless->fg = color;
+              else
+                headless->bg = color;
+            }
+        }
+      break;
+    }
+
+  /* Cursor movements stop at the screen edges. */
+  headless->cursor_x = CONGE_MAX (0, CONGE_MIN (headless->cursor_x,
+                                                headless->cols - 1));
+  headless->cursor_y = CONGE_MAX (0, CONGE_MIN (headless->cursor_y,
+                                                headless->rows - 1));
+}
+
+/*
+ * Update the screen with the written bytes.
+ */
+void
+conge_headless_interpret (conge_headless* headless, const char* data,
+                          int length)
+{
+  int i;
+
+  for (i = 0; i < length; i++)
+    {
+      unsigned char byte = data[i];
+
+      if (headless->sequence_length > 0)
+        {
+          char* sequence = headless->sequence;
+          int complete;
+
+          /* Drop sequences too long to be ours. */
+          if (headless->sequence_length == sizeof (headless->sequence))
+            headless->sequence_length = 0;
+
+          sequence[headless->sequence_length++] = byte;
+
+          if (headless->sequence_length < 2)
+            continue;
+
+          if (sequence[1] == '[') /* CSI ends with a letter */
+            complete = headless->sequence_length > 2
+              && byte >= 0x40 && byte <= 0x7E;
+          else if (sequence[1] == ']') /* OSC ends with BEL */
+            complete = byte == '\a';
+          else
+            complete = 1;
+
+          if (complete)
+            {
+              if (sequence[1] == '[')
+                conge_headless_execute (headless, sequence,
+                                        headless->sequence_length);
+
+              headless->sequence_length = 0;
+            }
+        }
+      else if (headless->utf8 && byte >= 32)
+        conge_headless_decode (headless, byte);
+      else if (headless->character_length > 0)
+        {
+          /* Control characters cut the character off; try this one again. */
+          conge_headless_flush_character (headless);
+          i--;
+        }
+      else if (byte == '\033')
+        headless->sequence[headless->sequence_length++] = byte;
+      else if (byte == '\r')
+        {
+          headless->cursor_x = 0;
+          headless->wrap = 0;
+        }
+      else if (byte == '\n')
+        {
+          headless->wrap = 0;
+          conge_headless_line_feed (headless);
+        }
+      else if (byte >= 32)
+        conge_headless_print (headless, byte);
+    }
+}
+
+void
+conge_open_headless (conge_ctx* ctx)
+{
+}
+
+void
+conge_close_headless (conge_ctx* ctx)
+{
+  conge_reset_output (ctx);
+}
+
+void
+conge_get_headless_size (conge_ctx* ctx)
+{
+  ctx->cols = ctx->_headless->cols;
+  ctx->rows = ctx->_headless->rows;
+}
+
+int
+conge_read_headless_input (conge_ctx* ctx)
+{
+  conge_headless* headless = ctx->_headless;
+  int i, count = headless->event_count;
+
+  for (i = 0; i < count; i++)
+    conge_read_event (ctx, &headless->events[i]);
+
+  headless->event_count = 0;
+
+  return count > 0;
+}
+
+void
+conge_handle_headless_input (conge_ctx* ctx)
+{
+  int prev_x = ctx->mouse_x, prev_y = ctx->mouse_y;
+
+  conge_take_input (ctx);
+
+  /* There's no pointer to grab, so report its movement in cells. */
+  ctx->mouse_dx = ctx->grab ? ctx->mouse_x - prev_x : 0;
+  ctx->mouse_dy = ctx->grab ? ctx->mouse_y - prev_y : 0;
+}
+
+int
+conge_write_headless (conge_ctx* ctx, const char* data, int length)
+{
+  conge_headless* headless = ctx->_headless;
+
+  /* The console stays in one format while it's open. */
+  headless->utf8 = ctx->format == CONGE_FORMAT_WIDE;
+  conge_headless_interpret (headless, data, length);
+
+  /* Keep the bytes for conge_headless_read_output. */
+  if (headless->output_length + length > headless->output_capacity)
+    {
+      int capacity = CONGE_MAX (4096, 2 * headless->output_capacity);
+      char* output;
+
+      while (capacity < headless->output_length + length)
+        capacity *= 2;
+
+      if (headless->output == NULL)
+        output = malloc (capacity);
+      else
+        output = realloc (headless->output, capacity);
+
+      /* The screen is still up to date, which matters more. */
+      if (output == NULL)
+        return length;
+
+      headless->output = output;
+      headless->output_capacity = capacity;
+    }
+
+  memcpy (headless->output + headless->output_length, data, length);
+  headless->output_length += length;
+
+  return length;
+}
+
+double
+conge_headless_time (conge_ctx* ctx)
+{
+  return ctx->_headless->time;
+}
+
+void
+conge_headless_sleep (conge_ctx* ctx, double seconds)
+{
+  ctx->_headless->time += seconds;
+}
+
+void
+conge_headless_wait (conge_ctx* ctx, double seconds)
+{
+  /* Events only get queued between frames, so waiting can't bring any. */
+  if (ctx->_headless->event_count == 0)
+    ctx->_headless->time += seconds > 0.0 ? seconds : ctx->timestep;
+}
+
+const conge_backend conge_headless_backend =
+  {
+    conge_open_headless,
+    conge_close_headless,
+    conge_get_headless_size,
+    conge_handle_headless_input,
+    conge_read_headless_input,
+    conge_write_headless,
+    conge_headless_time,
+    conge_headless_sleep,
+    conge_headless_wait,
+  };
+
+conge_ctx*
+conge_init_headless (int cols, int rows)
+{
+  conge_ctx* ctx;
+  conge_headless* headless;
+
+  if (cols < 1 || rows < 1)
+    return NULL;
+
+  ctx = conge_init ();
+
+  if (ctx == NULL)
+    return NULL;
+
+  headless = malloc (sizeof (*headless));
+
+  if (headless == NULL)
+    {
+      conge_free (ctx);
+      return NULL;
+    }
+
+  headless->cols = 0;
+  headless->rows = 0;
+  headless->cells = NULL;
+
+  headless->cursor_x = 0;
+  headless->cursor_y = 0;
+  headless->wrap = 0;
+
+  headless->fg = CONGE_PALETTE (CONGE_WHITE);
+  headless->bg = CONGE_PALETTE (CONGE_BLACK);
+
+  headless->utf8 = 0;
+  headless->character_length = 0;
+  headless->sequence_length = 0;
+
+  headless->output = NULL;
+  headless->output_length = 0;
+  headless->output_capacity = 0;
+
+  headless->time = 0.0;
+  headless->event_count = 0;
+
+  ctx->_headless = headless;
+  ctx->_backend = &conge_headless_backend;
+
+  if (conge_headless_resize (ctx, cols, rows))
+    {
+      conge_free (ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+void
+conge_free_headless (conge_ctx* ctx)
+{
+  if (ctx->_headless != NULL)
+    {
+      free (ctx->_headless->cells);
+      free (ctx->_headless->output);
+      free (ctx->_headless);
+
+      ctx->_headless = NULL;
+    }
+}
+
+int
+conge_headless_push_event (conge_ctx* ctx, const conge_event* event)
+{
+  if (ctx == NULL || ctx->_headless == NULL)
+    return 1;
+
+  if (event == NULL)
+    return 2;
+
+  if (ctx->_headless->event_count == CONGE__HEADLESS_EVENTS)
+    return 3;
+
+  ctx->_headless->events[ctx->_headless->event_count++] = *event;
+  return 0;
+}
+
+int
+conge_headless_resize (conge_ctx* ctx, int cols, int rows)
+{
+  conge_headless* headless;
+  conge_wide_pixel* cells;
+  int i;
+
+  if (ctx == NULL || ctx->_headless == NULL)
+    return 1;
+
+  if (cols < 1 || rows < 1)
+    return 2;
+
+  /* The presenter might still be drawing into the old screen. */
+  conge_finish_presenting (ctx);
+
+  headless = ctx->_headless;
+  cells = malloc (rows * cols * sizeof (*cells));
+
+  if (cells == NULL)
+    return 3;
+
+  /* Like most terminals, start over with a blank screen. */
+  for (i = 0; i < rows * cols; i++)
+    conge_headless_blank (&cells[i]);
+
+  free (headless->cells);
+
+  headless->cells = cells;
+  headless->cols = cols;
+  headless->rows = rows;
+
+  headless->cursor_x = CONGE_MIN (headless->cursor_x, cols - 1);
+  headless->cursor_y = CONGE_MIN (headless->cursor_y, rows - 1);
+  headless->wrap = 0;
+
+  return 0;
+}
+
+const char*
+conge_headless_read_output (conge_ctx* ctx, int* length)
+{
+  if (ctx == NULL || ctx->_headless == NULL)
+    return NULL;
+
+  conge_finish_presenting (ctx);
+
+  if (length != NULL)
+    *length = ctx->_headless->output_length;
+
+  /* The bytes get overwritten by the next write. */
+  ctx->_headless->output_length = 0;
+
+  return ctx->_headless->output;
+}
+
+conge_pixel
+conge_headless_get_cell (conge_ctx* ctx, int x, int y)
+{
+  conge_headless* headless;
+
+  if (ctx == NULL || ctx->_headless == NULL)
+    return 0;
+
+  conge_finish_presenting (ctx);
+  headless = ctx->_headless;
+
+  if (x < 0 || y < 0 || x >= headless->cols || y >= headless->rows)
+    return 0;
+
+  return conge_narrow_pixel (headless->cells[headless->cols * y + x]);
+}
+
+conge_wide_pixel
+conge_headless_get_wide_cell (conge_ctx* ctx, int x, int y)
+{
+  conge_wide_pixel cell = {0, 0, 0};
+  conge_headless* headless;
+
+  if (ctx == NULL || ctx->_headless == NULL)
+    return cell;
+
+  conge_finish_presenting (ctx);
+  headless = ctx->_headless;
+
+  if (x < 0 || y < 0 || x >= headless->cols || y >= headless->rows)
+    return cell;
+
+  return headless->cells[headless->cols * y + x];
+}
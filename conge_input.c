@@ -1,15 +1,38 @@
 #include "conge.h"
 
+/* The events the input thread can get ahead by; a power of two. */
+#define CONGE__INPUT_QUEUE 1024
+
+/* The input thread checks whether to quit at least this often. */
+#define CONGE__INPUT_POLL 0.05
+
+/*
+ * The input thread's events, on their way to the main thread. Only the input
+ * thread writes TAIL and only the main thread writes HEAD, so the ring needs
+ * no lock; the mutex is just for waking up an idle main thread.
+ */
+struct conge_input_queue
+{
+  conge_thread thread;
+  volatile long quit;
+  volatile long tail; /* the events read so far */
+  conge_event events[CONGE__INPUT_QUEUE];
+  volatile long head; /* the events taken so far */
+  conge_mutex mutex;
+  conge_cond arrived;
+  int signaled; /* guarded by MUTEX: set if something came */
+};
+
 int
 conge_is_key_down (conge_ctx* ctx, int code)
 {
   int index, offset;
 
-  if (ctx == NULL)
+  if (ctx == NULL || code < 0 || code >= 256)
     return 0;
 
-  index = code / (8 * sizeof (ctx->_keys));
-  offset = code % (8 * sizeof (ctx->_keys));
+  index = code / (8 * sizeof (*ctx->_keys));
+  offset = code % (8 * sizeof (*ctx->_keys));
 
   /* !! converts to a "true" boolean value (either 1 or 0). */
   return !!(ctx->_keys[index] & (1 << offset));
@@ -20,11 +43,11 @@ conge_is_key_just_pressed (conge_ctx* ctx, int code)
 {
   int index, offset, prev, curr;
 
-  if (ctx == NULL)
+  if (ctx == NULL || code < 0 || code >= 256)
     return 0;
 
-  index = code / (8 * sizeof (ctx->_keys));
-  offset = code % (8 * sizeof (ctx->_keys));
+  index = code / (8 * sizeof (*ctx->_keys));
+  offset = code % (8 * sizeof (*ctx->_keys));
 
   prev = ctx->_prev_keys[index] & (1 << offset);
   curr = ctx->_keys[index] & (1 << offset);
@@ -41,97 +64,298 @@ conge_is_button_down (conge_ctx* ctx, int mask)
     return !!(ctx->_buttons & mask);
 }
 
-/*
- * Update mouse cursor positions (in pixels), and handle mouse grab.
- */
 void
-conge_process_mouse (conge_ctx* ctx)
+conge_set_key (conge_ctx* ctx, int code, int down)
 {
-  if (ctx->grab)
-    {
-      POINT mouse_p;
-      RECT window;
+  /* To make a 256-bit bitflag, we split it into 8 32-bit ints. */
+  int index = code / (8 * sizeof (*ctx->_keys));
+
+  /* The remainder is just the offset of that bit in the flag. */
+  int offset = code % (8 * sizeof (*ctx->_keys));
 
-      GetCursorPos (&mouse_p);
-      GetWindowRect (ctx->_window, &window);
+  int mask = 1 << offset;
 
-      /* Find the center of the console window. */
-      int cx = window.left + (window.right - window.left) / 2;
-      int cy = window.top  + (window.bottom - window.top) / 2;
+  if (code < 0 || code >= 256)
+    return;
 
-      ctx->mouse_dx = mouse_p.x - cx;
-      ctx->mouse_dy = mouse_p.y - cy;
+  /* Set/unset the bit. */
+  if (down)
+    ctx->_keys[index] |= mask;
+  else
+    ctx->_keys[index] &= ~mask;
+}
 
-      SetCursorPos (cx, cy);
+void
+conge_apply_event (conge_ctx* ctx, const conge_event* event)
+{
+  switch (event->type)
+    {
+    case CONGE_EVENT_KEY_DOWN:
+    case CONGE_EVENT_KEY_UP:
+      conge_set_key (ctx, event->code, event->type == CONGE_EVENT_KEY_DOWN);
+      break;
+    case CONGE_EVENT_MOUSE_MOVE:
+      ctx->mouse_x = event->x;
+      ctx->mouse_y = event->y;
+      break;
+    case CONGE_EVENT_BUTTON_DOWN:
+      ctx->mouse_x = event->x;
+      ctx->mouse_y = event->y;
+      ctx->_buttons |= event->code;
+      break;
+    case CONGE_EVENT_BUTTON_UP:
+      ctx->mouse_x = event->x;
+      ctx->mouse_y = event->y;
+      ctx->_buttons &= ~event->code;
+      break;
+    case CONGE_EVENT_SCROLL:
+      ctx->mouse_x = event->x;
+      ctx->mouse_y = event->y;
+      ctx->scroll = event->scroll;
+      break;
     }
+}
+
+void
+conge_push_event (conge_ctx* ctx, conge_event* event)
+{
+  int index = ctx->_event_first + ctx->_event_count;
+
+  event->time = ctx->elapsed + event->time - ctx->_frame_start;
+  conge_apply_event (ctx, event);
+
+  /* Keep the newest events when there are too many. */
+  if (ctx->_event_count < CONGE_MAX_EVENTS)
+    ctx->_event_count++;
   else
+    ctx->_event_first = (ctx->_event_first + 1) % CONGE_MAX_EVENTS;
+
+  ctx->_events[index % CONGE_MAX_EVENTS] = *event;
+}
+
+void
+conge_read_event (conge_ctx* ctx, conge_event* event)
+{
+  conge_input_queue* queue = ctx->_input_queue;
+  unsigned long tail;
+
+  event->time = ctx->_backend->now (ctx);
+
+  if (queue == NULL)
     {
-      ctx->mouse_dx = 0;
-      ctx->mouse_dy = 0;
+      conge_push_event (ctx, event);
+      return;
     }
+
+  tail = queue->tail;
+
+  /* Dropping events could leave keys stuck, so wait for the main thread. */
+  while (tail - (unsigned long) conge_atomic_load (&queue->head)
+         >= CONGE__INPUT_QUEUE)
+    {
+      if (conge_atomic_load (&queue->quit))
+        return;
+
+      ctx->_backend->sleep (ctx, 0.001);
+    }
+
+  queue->events[tail % CONGE__INPUT_QUEUE] = *event;
+  conge_atomic_store (&queue->tail, tail + 1);
 }
 
 void
-conge_handle_input (conge_ctx* ctx)
+conge_take_input (conge_ctx* ctx)
 {
-  int i;
+  conge_input_queue* queue = ctx->_input_queue;
+  unsigned long head, tail;
 
-  INPUT_RECORD records[10];
-  DWORD count;
+  if (queue == NULL)
+    {
+      ctx->_backend->read_input (ctx);
+      return;
+    }
 
-  ctx->scroll = 0;
+  head = queue->head;
+  tail = conge_atomic_load (&queue->tail);
+
+  for (; head != tail; head++)
+    conge_push_event (ctx, &queue->events[head % CONGE__INPUT_QUEUE]);
+
+  conge_atomic_store (&queue->head, head);
+}
+
+void
+conge_wait_for_input (conge_ctx* ctx, double seconds)
+{
+  conge_input_queue* queue = ctx->_input_queue;
+  double deadline = ctx->_backend->now (ctx) + seconds;
+
+  if (queue == NULL)
+    {
+      ctx->_backend->wait (ctx, seconds);
+      return;
+    }
+
+  conge_mutex_lock (&queue->mutex);
+
+  while (!queue->signaled)
+    {
+      if (seconds <= 0.0)
+        conge_cond_wait (&queue->arrived, &queue->mutex);
+      else if (deadline <= ctx->_backend->now (ctx)
+               || conge_cond_timed_wait (&queue->arrived, &queue->mutex,
+                                         deadline - ctx->_backend->now (ctx)))
+        break;
+    }
+
+  queue->signaled = 0;
+  conge_mutex_unlock (&queue->mutex);
+}
+
+void
+conge_input_thread (void* data)
+{
+  conge_ctx* ctx = data;
+  conge_input_queue* queue = ctx->_input_queue;
+
+  while (!conge_atomic_load (&queue->quit))
+    {
+      ctx->_backend->wait (ctx, CONGE__INPUT_POLL);
 
-  conge_process_mouse (ctx);
+      if (!ctx->_backend->read_input (ctx))
+        continue;
 
-  GetNumberOfConsoleInputEvents (ctx->_input, &count);
+      /* Wake the main thread up in case it's idle. */
+      conge_mutex_lock (&queue->mutex);
+      queue->signaled = 1;
+      conge_cond_broadcast (&queue->arrived);
+      conge_mutex_unlock (&queue->mutex);
+    }
+}
+
+int
+conge_start_input_thread (conge_ctx* ctx)
+{
+  conge_input_queue* queue;
+
+  if (ctx->_input_queue != NULL)
+    return 0;
+
+  queue = malloc (sizeof (*queue));
+
+  if (queue == NULL)
+    return 1;
+
+  queue->quit = 0;
+  queue->tail = 0;
+  queue->head = 0;
+  queue->signaled = 0;
+
+  if (conge_mutex_init (&queue->mutex))
+    {
+      free (queue);
+      return 1;
+    }
+
+  if (conge_cond_init (&queue->arrived))
+    {
+      conge_mutex_destroy (&queue->mutex);
+      free (queue);
+      return 1;
+    }
 
-  if (!count)
+  /* Set before the thread starts, so that it knows where to read to. */
+  ctx->_input_queue = queue;
+
+  if (conge_thread_start (&queue->thread, conge_input_thread, ctx))
+    {
+      ctx->_input_queue = NULL;
+      conge_cond_destroy (&queue->arrived);
+      conge_mutex_destroy (&queue->mutex);
+      free (queue);
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+conge_stop_input_thread (conge_ctx* ctx)
+{
+  conge_input_queue* queue = ctx->_input_queue;
+
+  if (queue == NULL)
     return;
 
-  ReadConsoleInput (ctx->_input, records, 10, &count);
+  conge_atomic_store (&queue->quit, 1);
+  conge_thread_join (&queue->thread);
 
-  /* Copy the previous frame's key flags. */
-  for (i = 0; i < CONGE__KEYS_LENGTH; i++)
-    ctx->_prev_keys[i] = ctx->_keys[i];
+  /* Whatever it read and nobody took is lost. */
+  ctx->_input_queue = NULL;
+
+  conge_cond_destroy (&queue->arrived);
+  conge_mutex_destroy (&queue->mutex);
+  free (queue);
+}
+
+int
+conge_set_input_thread (conge_ctx* ctx, int enable)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->_headless != NULL)
+    return 2;
+
+  ctx->_input_threaded = enable;
+
+  /* Otherwise it starts with the console. */
+  if (!ctx->_open)
+    return 0;
+
+  if (!enable)
+    {
+      conge_stop_input_thread (ctx);
+      return 0;
+    }
 
-  for (i = 0; i < count; i++)
+  if (conge_start_input_thread (ctx))
     {
-      if (records[i].EventType == KEY_EVENT)
-        {
-          KEY_EVENT_RECORD event = records[i].Event.KeyEvent;
-          WORD scancode = event.wVirtualScanCode;
-
-          if (scancode < 256)
-            {
-              /* To make a 256-bit bitflag, we split it into 8 32-bit ints. */
-              int index = scancode / (8 * sizeof (ctx->_keys));
-
-              /* The remainder is just the offset of that bit in the flag. */
-              int offset = scancode % (8 * sizeof (ctx->_keys));
-
-              int mask = 1 << offset;
-
-              /* Set/unset the bit. */
-              if (event.bKeyDown)
-                ctx->_keys[index] |= mask;
-              else
-                ctx->_keys[index] &= ~mask;
-            }
-        }
-      else if (records[i].EventType == MOUSE_EVENT)
-        {
-          MOUSE_EVENT_RECORD event = records[i].Event.MouseEvent;
-
-          ctx->mouse_x = event.dwMousePosition.X;
-          ctx->mouse_y = event.dwMousePosition.Y;
-
-          if (event.dwEventFlags & MOUSE_WHEELED)
-            {
-              int scroll = event.dwButtonState;
-              ctx->scroll = scroll / abs (scroll); /* clamp between -1 and 1 */
-            }
-          else
-            ctx->_buttons = event.dwButtonState;
-        }
+      ctx->_input_threaded = 0;
+      return 3;
     }
+
+  return 0;
+}
+
+int
+conge_next_event (conge_ctx* ctx, conge_event* event)
+{
+  if (ctx == NULL || event == NULL || ctx->_event_count == 0)
+    return 0;
+
+  *event = ctx->_events[ctx->_event_first];
+
+  ctx->_event_first = (ctx->_event_first + 1) % CONGE_MAX_EVENTS;
+  ctx->_event_count--;
+
+  return 1;
+}
+
+void
+conge_handle_input (conge_ctx* ctx)
+{
+  int i;
+
+  ctx->scroll = 0;
+
+  /* Copy the previous frame's key flags, whether any input comes or not. */
+  for (i = 0; i < CONGE__KEYS_LENGTH; i++)
+    ctx->_prev_keys[i] = ctx->_keys[i];
+
+  /* Whatever wasn't taken last frame is stale now. */
+  ctx->_event_first = 0;
+  ctx->_event_count = 0;
+
+  ctx->_backend->handle_input (ctx);
 }
@@ -0,0 +1,366 @@
+/* Layers, composited into the frame where they change. */
+
+#include "conge.h"
+
+struct conge_layer
+{
+  conge_layer* next; /* the one above it, or null */
+  int depth; /* the stack is sorted by it, from the bottom */
+  int visible;
+  conge_pixel* pixels; /* row by row, unless the format is wide */
+  conge_wide_pixel* wide; /* or these if it is */
+  conge_span* dirty; /* per row: the pixels changed since composited */
+  conge_span* used; /* per row: the pixels drawn since it was cleared */
+  int rows, cols; /* the size its buffers were made for */
+  void* buffers; /* the block they are all in */
+};
+
+/*
+ * Mark every row of SPANS as empty, or as full if FULL is set.
+ */
+void
+conge_reset_layer_spans (conge_layer* layer, conge_span* spans, int full)
+{
+  int y;
+
+  for (y = 0; y < layer->rows; y++)
+    {
+      spans[y].min = full ? 0 : layer->cols;
+      spans[y].max = full ? layer->cols - 1 : -1;
+    }
+}
+
+/*
+ * Extend the spans of TO to cover the ones of FROM.
+ */
+void
+conge_merge_spans (conge_layer* layer, conge_span* to, const conge_span* from)
+{
+  int y;
+
+  for (y = 0; y < layer->rows; y++)
+    {
+      to[y].min = CONGE_MIN (to[y].min, from[y].min);
+      to[y].max = CONGE_MAX (to[y].max, from[y].max);
+    }
+}
+
+/*
+ * Make LAYER's buffers COLS by ROWS in FORMAT, keeping whatever of its
+ * pixels still fits. Return 1 if memory allocation failed.
+ */
+int
+conge_resize_layer (conge_layer* layer, int cols, int rows, int format)
+{
+  int wide = format == CONGE_FORMAT_WIDE, y, keep;
+  size_t cell = wide ? sizeof (conge_wide_pixel) : sizeof (conge_pixel);
+  size_t spans = 2 * (size_t) rows * sizeof (conge_span);
+  char *block, *old;
+
+  /* The spans come first, so that both keep malloc's alignment. */
+  block = malloc (spans + (size_t) rows * cols * cell);
+
+  if (block == NULL)
+    return 1;
+
+  /* Layers start out transparent. */
+  memset (block + spans, 0, (size_t) rows * cols * cell);
+
+  /* A format change has nothing to keep; it only happens before a frame. */
+  old = wide ? (char*) layer->wide : (char*) layer->pixels;
+  keep = CONGE_MIN (cols, layer->cols);
+
+  for (y = 0; y < CONGE_MIN (rows, layer->rows) && old != NULL; y++)
+    memcpy (block + spans + (size_t) cols * y * cell,
+            old + (size_t) layer->cols * y * cell, keep * cell);
+
+  free (layer->buffers);
+
+  layer->buffers = block;
+  layer->pixels = wide ? NULL : (conge_pixel*) (block + spans);
+  layer->wide = wide ? (conge_wide_pixel*) (block + spans) : NULL;
+  layer->dirty = (conge_span*) block;
+  layer->used = layer->dirty + rows;
+  layer->rows = rows;
+  layer->cols = cols;
+
+  conge_reset_layer_spans (layer, layer->used, 1);
+  return 0;
+}
+
+conge_layer*
+conge_layer_new (conge_ctx* ctx, int depth)
+{
+  conge_layer *layer, **below;
+
+  if (ctx == NULL)
+    return NULL;
+
+  layer = malloc (sizeof (*layer));
+
+  if (layer == NULL)
+    return NULL;
+
+  layer->depth = depth;
+  layer->visible = 1;
+  layer->buffers = NULL;
+  layer->pixels = NULL;
+  layer->wide = NULL;
+  layer->dirty = NULL;
+  layer->used = NULL;
+  layer->rows = 0;
+  layer->cols = 0;
+
+  /* Without a frame yet, the buffers are made along with it. */
+  if (ctx->_swap_count > 0)
+    {
+      if (conge_resize_layer (layer, ctx->_buffer_cols, ctx->_buffer_rows,
+                              ctx->_buffer_format))
+        {
+          free (layer);
+          return NULL;
+        }
+
+      conge_reset_layer_spans (layer, layer->dirty, 0);
+      conge_reset_layer_spans (layer, layer->used, 0);
+    }
+
+  /* Layers of the same depth go above the ones already there. */
+  for (below = &ctx->_layers; *below != NULL; below = &(*below)->next)
+    if ((*below)->depth > depth)
+      break;
+
+  layer->next = *below;
+  *below = layer;
+
+  return layer;
+}
+
+void
+conge_layer_free (conge_ctx* ctx, conge_layer* layer)
+{
+  conge_layer** link;
+
+  if (ctx == NULL || layer == NULL)
+    return;
+
+  for (link = &ctx->_layers; *link != NULL; link = &(*link)->next)
+    if (*link == layer)
+      break;
+
+  if (*link == NULL)
+    return;
+
+  *link = layer->next;
+
+  if (ctx->_dirty == layer->dirty && ctx->_swap_count > 0)
+    conge_draw_into (ctx, NULL);
+
+  /*
+   * What the layer covered is composited again from the ones left, or the
+   * whole frame is cleared if it was the last one.
+   */
+  if (ctx->_layers != NULL && layer->rows == ctx->_layers->rows
+      && layer->cols == ctx->_layers->cols)
+    {
+      conge_merge_spans (layer, layer->used, layer->dirty);
+      conge_merge_spans (layer, ctx->_layers->dirty, layer->used);
+    }
+
+  free (layer->buffers);
+  free (layer);
+}
+
+void
+conge_free_layers (conge_ctx* ctx)
+{
+  while (ctx->_layers != NULL)
+    {
+      conge_layer* layer = ctx->_layers;
+
+      ctx->_layers = layer->next;
+
+      free (layer->buffers);
+      free (layer);
+    }
+}
+
+int
+conge_draw_into (conge_ctx* ctx, conge_layer* layer)
+{
+  conge_swap* swap;
+
+  if (ctx == NULL)
+    return 1;
+
+  /* Layers only get their buffers with the first frame. */
+  if (ctx->_swap_count == 0 || (layer != NULL && layer->rows == 0))
+    return 2;
+
+  if (layer != NULL)
+    {
+      ctx->frame = layer->pixels;
+      ctx->wide_frame = layer->wide;
+      ctx->_dirty = layer->dirty;
+    }
+  else
+    {
+      swap = &ctx->_swaps[ctx->_frames_submitted % ctx->_swap_count];
+
+      ctx->frame = swap->pixels;
+      ctx->wide_frame = swap->wide;
+      ctx->_dirty = swap->dirty;
+    }
+
+  return 0;
+}
+
+int
+conge_clear_layer (conge_ctx* ctx, conge_layer* layer)
+{
+  int y;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (layer == NULL)
+    return 2;
+
+  /* Only what was drawn since the last clear needs clearing now. */
+  conge_merge_spans (layer, layer->used, layer->dirty);
+
+  for (y = 0; y < layer->rows; y++)
+    {
+      conge_span* used = &layer->used[y];
+      long offset = (long) layer->cols * y + used->min;
+
+      if (used->min > used->max)
+        continue;
+
+      if (layer->wide != NULL)
+        memset (&layer->wide[offset], 0,
+                (used->max - used->min + 1) * sizeof (*layer->wide));
+      else
+        memset (&layer->pixels[offset], 0,
+                (used->max - used->min + 1) * sizeof (*layer->pixels));
+    }
+
+  conge_merge_spans (layer, layer->dirty, layer->used);
+  conge_reset_layer_spans (layer, layer->used, 0);
+
+  return 0;
+}
+
+int
+conge_show_layer (conge_ctx* ctx, conge_layer* layer, int visible)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (layer == NULL)
+    return 2;
+
+  visible = visible != 0;
+
+  if (visible != layer->visible)
+    {
+      layer->visible = visible;
+
+      /* Whatever it covers appears or disappears. */
+      conge_merge_spans (layer, layer->used, layer->dirty);
+      conge_merge_spans (layer, layer->dirty, layer->used);
+    }
+
+  return 0;
+}
+
+int
+conge_fit_layers (conge_ctx* ctx)
+{
+  conge_layer* layer;
+
+  for (layer = ctx->_layers; layer != NULL; layer = layer->next)
+    {
+      if ((layer->rows != ctx->_buffer_rows
+           || layer->cols != ctx->_buffer_cols
+           || (layer->wide != NULL) != (ctx->_buffer_format
+                                        == CONGE_FORMAT_WIDE))
+          && conge_resize_layer (layer, ctx->_buffer_cols, ctx->_buffer_rows,
+                                 ctx->_buffer_format))
+        return 1;
+
+      /* The frame buffers start over from a clear screen. */
+      conge_reset_layer_spans (layer, layer->dirty, 1);
+    }
+
+  return 0;
+}
+
+/*
+ * Composite row Y of the layers from MIN to MAX into TARGET.
+ */
+void
+conge_composite_row (conge_ctx* ctx, const conge_target* target, int y,
+                     int min, int max)
+{
+  conge_pixel blank = conge_new_pixel (' ', CONGE_WHITE, CONGE_BLACK);
+  long offset = (long) target->stride * y + min;
+  int count = max - min + 1;
+  conge_layer* layer;
+
+  /* The bottom of the stack is a clear frame. */
+  if (target->wide != NULL)
+    conge_fill_wide_pixels (&target->wide[offset], count,
+                            conge_widen_pixel (blank));
+  else
+    conge_fill_pixels (&target->pixels[offset], count, blank);
+
+  for (layer = ctx->_layers; layer != NULL; layer = layer->next)
+    {
+      if (!layer->visible)
+        continue;
+
+      if (target->wide != NULL)
+        conge_blit_wide_row (target, offset, &layer->wide[offset], count, 0);
+      else
+        conge_blit_row (target, offset, &layer->pixels[offset], count, 0, 0);
+    }
+}
+
+void
+conge_composite_layers (conge_ctx* ctx)
+{
+  conge_target target;
+  conge_layer* layer;
+  int y;
+
+  if (ctx->_layers == NULL)
+    return;
+
+  /* The layers are composited into the frame, not the one drawn into. */
+  conge_draw_into (ctx, NULL);
+  conge_frame_target (ctx, &target);
+
+  for (y = 0; y < ctx->rows; y++)
+    {
+      int min = ctx->cols, max = -1;
+
+      for (layer = ctx->_layers; layer != NULL; layer = layer->next)
+        {
+          min = CONGE_MIN (min, layer->dirty[y].min);
+          max = CONGE_MAX (max, layer->dirty[y].max);
+        }
+
+      if (min > max)
+        continue;
+
+      conge_composite_row (ctx, &target, y, min, max);
+      conge_mark_dirty (ctx, y, min, max);
+    }
+
+  for (layer = ctx->_layers; layer != NULL; layer = layer->next)
+    {
+      conge_merge_spans (layer, layer->used, layer->dirty);
+      conge_reset_layer_spans (layer, layer->dirty, 0);
+    }
+}
@@ -0,0 +1,741 @@
+#include "conge.h"
+
+/* The longest escape sequence pair a single pixel can produce, plus itself. */
+#define CONGE__PIXEL_OUTPUT_MAX 32
+
+/* The same for wide pixels, with true colors and UTF-8. */
+#define CONGE__WIDE_OUTPUT_MAX 64
+
+/* Console color numbers in the order VT color sequences expect them. */
+const int conge_vt_colors[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+/*
+ * Write the whole output buffer to the console, then empty it.
+ */
+void
+conge_flush_output (conge_ctx* ctx)
+{
+  int offset = 0;
+
+  while (offset < ctx->_output_length)
+    {
+      int written = ctx->_backend->write (ctx, ctx->_output_buffer + offset,
+                                          ctx->_output_length - offset);
+
+      ctx->_presenting->stats.writes++;
+
+      /* Don't spin on a broken stdout. */
+      if (written <= 0)
+        break;
+
+      offset += written;
+    }
+
+  ctx->_presenting->stats.bytes += offset;
+  ctx->_output_length = 0;
+}
+
+/*
+ * Make room for SIZE more bytes in the output buffer.
+ *
+ * If the buffer can't grow, it gets flushed to make room instead.
+ *
+ * Return 1 if there's still not enough room, 0 otherwise.
+ */
+int
+conge_reserve_output (conge_ctx* ctx, int size)
+{
+  int capacity = ctx->_output_capacity;
+  char* buffer;
+
+  if (ctx->_output_length + size <= capacity)
+    return 0;
+
+  if (capacity == 0)
+    capacity = 4096;
+
+  while (capacity < ctx->_output_length + size)
+    capacity *= 2;
+
+  if (ctx->_output_buffer == NULL)
+    buffer = malloc (capacity);
+  else
+    buffer = realloc (ctx->_output_buffer, capacity);
+
+  if (buffer != NULL)
+    {
+      ctx->_output_buffer = buffer;
+      ctx->_output_capacity = capacity;
+      return 0;
+    }
+
+  conge_flush_output (ctx);
+  return size > ctx->_output_capacity;
+}
+
+/*
+ * Append a non-negative number in decimal. The space must be reserved.
+ */
+void
+conge_put_number (conge_ctx* ctx, int number)
+{
+  char digits[16];
+  int count = 0;
+
+  do
+    {
+      digits[count++] = '0' + number % 10;
+      number /= 10;
+    }
+  while (number > 0);
+
+  while (count > 0)
+    ctx->_output_buffer[ctx->_output_length++] = digits[--count];
+}
+
+/*
+ * Append a Control Sequence Introducer. The space must be reserved.
+ */
+void
+conge_put_csi (conge_ctx* ctx)
+{
+  ctx->_output_buffer[ctx->_output_length++] = '\033';
+  ctx->_output_buffer[ctx->_output_length++] = '[';
+}
+
+/*
+ * Append a string, reserving the space for it.
+ */
+void
+conge_put_string (conge_ctx* ctx, const char* string)
+{
+  int length = strlen (string);
+
+  if (conge_reserve_output (ctx, length))
+    return;
+
+  memcpy (ctx->_output_buffer + ctx->_output_length, string, length);
+  ctx->_output_length += length;
+}
+
+/*
+ * Return the amount of decimal digits in a non-negative number.
+ */
+int
+conge_number_length (int number)
+{
+  int length = 1;
+
+  while (number >= 10)
+    {
+      number /= 10;
+      length++;
+    }
+
+  return length;
+}
+
+/*
+ * Append CSI, a count and the final byte. A count of 1 is implied.
+ */
+void
+conge_put_sequence (conge_ctx* ctx, int count, char final)
+{
+  conge_put_csi (ctx);
+
+  if (count != 1)
+    conge_put_number (ctx, count);
+
+  ctx->_output_buffer[ctx->_output_length++] = final;
+}
+
+/*
+ * Return the length of what conge_put_sequence would append.
+ */
+int
+conge_sequence_length (int count)
+{
+  return count == 1 ? 3 : 3 + conge_number_length (count);
+}
+
+/*
+ * Append the character a pixel shows. The space must be reserved.
+ */
+void
+conge_put_character (conge_ctx* ctx, conge_pixel pixel)
+{
+  unsigned char character = conge_get_character (pixel);
+
+  /* Control characters would mess up the escape sequences. */
+  if (character < 32 || character == 127)
+    character = ' ';
+
+#ifndef _WIN32
+  /* Terminals expect UTF-8, which the upper half of a byte isn't. */
+  if (character >= 128)
+    character = '?';
+#endif
+
+  ctx->_output_buffer[ctx->_output_length++] = character;
+}
+
+/*
+ * Append the character a wide pixel shows, in UTF-8. The space must be
+ * reserved.
+ */
+void
+conge_put_wide_character (conge_ctx* ctx, const conge_wide_pixel* pixel)
+{
+  unsigned int character = pixel->character;
+  char* output = ctx->_output_buffer + ctx->_output_length;
+
+  /* Control characters would mess up the escape sequences. */
+  if (character < 32 || (character >= 127 && character < 160))
+    character = ' ';
+  else if ((character >= 0xD800 && character <= 0xDFFF)
+           || character > 0x10FFFF)
+    character = '?';
+
+  if (character < 0x80)
+    {
+      output[0] = character;
+      ctx->_output_length += 1;
+    }
+  else if (character < 0x800)
+    {
+      output[0] = 0xC0 | (character >> 6);
+      output[1] = 0x80 | (character & 0x3F);
+      ctx->_output_length += 2;
+    }
+  else if (character < 0x10000)
+    {
+      output[0] = 0xE0 | (character >> 12);
+      output[1] = 0x80 | ((character >> 6) & 0x3F);
+      output[2] = 0x80 | (character & 0x3F);
+      ctx->_output_length += 3;
+    }
+  else
+    {
+      output[0] = 0xF0 | (character >> 18);
+      output[1] = 0x80 | ((character >> 12) & 0x3F);
+      output[2] = 0x80 | ((character >> 6) & 0x3F);
+      output[3] = 0x80 | (character & 0x3F);
+      ctx->_output_length += 4;
+    }
+}
+
+/*
+ * Return 1 if reprinting the wide pixels from FROM to TO in row Y would
+ * leave the colors as they are and take a byte each.
+ */
+int
+conge_can_reprint_wide (conge_ctx* ctx, int from, int to, int y)
+{
+  const conge_wide_pixel* row
+    = &ctx->_presenting->wide[ctx->_buffer_cols * y];
+  int x;
+
+  for (x = from; x < to; x++)
+    if (row[x].fg != ctx->_last_fg || row[x].bg != ctx->_last_bg
+        || row[x].character >= 0x80)
+      return 0;
+
+  return 1;
+}
+
+/* The ways to move the cursor within a row. */
+enum
+  {
+    CONGE__STAY,
+    CONGE__RETURN, /* carriage return */
+    CONGE__ABSOLUTE, /* CHA: jump to the column */
+    CONGE__FORWARD, /* CUF */
+    CONGE__BACKWARD, /* CUB */
+    CONGE__RETURN_FORWARD, /* carriage return, then CUF */
+    CONGE__REPRINT, /* print the unchanged pixels in between again */
+  };
+
+/*
+ * Find the cheapest way to move the cursor from column FROM to TO in row Y.
+ *
+ * FROM is negative if unknown. The unchanged pixels in between may only be
+ * reprinted if REPRINT is set. Store the method in METHOD, and return its
+ * length in bytes.
+ */
+int
+conge_plan_horizontal_move (conge_ctx* ctx, int from, int to, int y,
+                            int reprint, int* method)
+{
+  int cost;
+
+  if (from == to)
+    {
+      *method = CONGE__STAY;
+      return 0;
+    }
+
+  if (to == 0)
+    {
+      *method = CONGE__RETURN;
+      return 1;
+    }
+
+  *method = CONGE__ABSOLUTE;
+  cost = conge_sequence_length (to + 1);
+
+  if (1 + conge_sequence_length (to) < cost)
+    {
+      *method = CONGE__RETURN_FORWARD;
+      cost = 1 + conge_sequence_length (to);
+    }
+
+  if (from < 0)
+    return cost;
+
+  if (to < from && conge_sequence_length (from - to) < cost)
+    {
+      *method = CONGE__BACKWARD;
+      cost = conge_sequence_length (from - to);
+    }
+
+  if (to > from && conge_sequence_length (to - from) < cost)
+    {
+      *method = CONGE__FORWARD;
+      cost = conge_sequence_length (to - from);
+    }
+
+  /* Printing a few characters is shorter than any escape sequence. */
+  if (reprint && to > from && to - from < cost
+      && ctx->_presenting->wide != NULL)
+    {
+      if (!conge_can_reprint_wide (ctx, from, to, y))
+        return cost;
+
+      *method = CONGE__REPRINT;
+      cost = to - from;
+    }
+  else if (reprint && to > from && to - from < cost)
+    {
+      conge_pixel* row = &ctx->_presenting->pixels[ctx->_buffer_cols * y];
+      int x;
+
+      for (x = from; x < to; x++)
+        if ((row[x] >> 8) != ctx->_last_color)
+          return cost;
+
+      *method = CONGE__REPRINT;
+      cost = to - from;
+    }
+
+  return cost;
+}
+
+/*
+ * Move the cursor from column FROM to TO in row Y, with a planned METHOD.
+ */
+void
+conge_move_horizontally (conge_ctx* ctx, int from, int to, int y, int method)
+{
+  long row = (long) ctx->_buffer_cols * y;
+
+  switch (method)
+    {
+    case CONGE__RETURN:
+      ctx->_output_buffer[ctx->_output_length++] = '\r';
+      break;
+    case CONGE__ABSOLUTE:
+      conge_put_sequence (ctx, to + 1, 'G');
+      break;
+    case CONGE__FORWARD:
+      conge_put_sequence (ctx, to - from, 'C');
+      break;
+    case CONGE__BACKWARD:
+      conge_put_sequence (ctx, from - to, 'D');
+      break;
+    case CONGE__RETURN_FORWARD:
+      ctx->_output_buffer[ctx->_output_length++] = '\r';
+      conge_put_sequence (ctx, to, 'C');
+      break;
+    case CONGE__REPRINT:
+      for (; from < to; from++)
+        if (ctx->_presenting->wide != NULL)
+          conge_put_wide_character (ctx, &ctx->_presenting->wide[row + from]);
+        else
+          conge_put_character (ctx, ctx->_presenting->pixels[row + from]);
+      break;
+    }
+}
+
+/*
+ * Move the cursor using the shortest escape sequences possible.
+ *
+ * Does nothing if printing the previous pixel already moved it there.
+ */
+void
+conge_move_cursor_to (conge_ctx* ctx, int x, int y)
+{
+  int cx = ctx->_cursor_x, cy = ctx->_cursor_y;
+  int cost, method, vertical_cost, horizontal_cost, horizontal_method;
+  int best = -1;
+
+  enum { ABSOLUTE, RELATIVE, NEXT_LINE };
+
+  if (cx == x && cy == y)
+    return;
+
+  CONGE__TRACE (ctx->_presenting->stats.cursor_moves++);
+
+  /* Absolute positioning always works. */
+  method = ABSOLUTE;
+  cost = x == 0 && y == 0
+    ? 3 : 4 + conge_number_length (y + 1) + conge_number_length (x + 1);
+
+  if (cy >= 0)
+    {
+      /* Move vertically with CUU or CUD, then within the row. */
+      vertical_cost = y == cy ? 0 : conge_sequence_length (abs (y - cy));
+      horizontal_cost = conge_plan_horizontal_move (ctx, cx, x, y, y == cy,
+                                                    &horizontal_method);
+
+      if (vertical_cost + horizontal_cost < cost)
+        {
+          method = RELATIVE;
+          best = horizontal_method;
+          cost = vertical_cost + horizontal_cost;
+        }
+
+      /* CR LF goes to the start of the next line. */
+      if (y == cy + 1)
+        {
+          horizontal_cost = conge_plan_horizontal_move (ctx, 0, x, y, 0,
+                                                        &horizontal_method);
+
+          if (2 + horizontal_cost < cost)
+            {
+              method = NEXT_LINE;
+              best = horizontal_method;
+            }
+        }
+    }
+
+  switch (method)
+    {
+    case ABSOLUTE:
+      conge_put_csi (ctx);
+
+      /* The top-left corner is the default position. */
+      if (x != 0 || y != 0)
+        {
+          conge_put_number (ctx, y + 1);
+          ctx->_output_buffer[ctx->_output_length++] = ';';
+          conge_put_number (ctx, x + 1);
+        }
+
+      ctx->_output_buffer[ctx->_output_length++] = 'H';
+      break;
+    case RELATIVE:
+      if (y < cy)
+        conge_put_sequence (ctx, cy - y, 'A');
+      else if (y > cy)
+        conge_put_sequence (ctx, y - cy, 'B');
+
+      conge_move_horizontally (ctx, cx, x, y, best);
+      break;
+    case NEXT_LINE:
+      ctx->_output_buffer[ctx->_output_length++] = '\r';
+      ctx->_output_buffer[ctx->_output_length++] = '\n';
+
+      conge_move_horizontally (ctx, 0, x, y, best);
+      break;
+    }
+
+  ctx->_cursor_x = x;
+  ctx->_cursor_y = y;
+}
+
+/*
+ * Print all subsequent characters in this color.
+ *
+ * COLOR is a console attribute: 16 * bg + fg. Only the changed half of it
+ * is sent to the console.
+ */
+void
+conge_set_text_color (conge_ctx* ctx, int color)
+{
+  int fg = color & 0xF, bg = (color >> 4) & 0xF;
+  int fg_changed, bg_changed;
+
+  if (ctx->_last_color == color)
+    return;
+
+  CONGE__TRACE (ctx->_presenting->stats.color_changes++);
+
+  /* A negative color means we don't know what the console is showing. */
+  fg_changed = ctx->_last_color < 0 || (ctx->_last_color & 0xF) != fg;
+  bg_changed = ctx->_last_color < 0 || ((ctx->_last_color >> 4) & 0xF) != bg;
+
+  conge_put_csi (ctx);
+
+  if (fg_changed)
+    conge_put_number (ctx, (fg & 8 ? 90 : 30) + conge_vt_colors[fg & 7]);
+
+  if (fg_changed && bg_changed)
+    ctx->_output_buffer[ctx->_output_length++] = ';';
+
+  if (bg_changed)
+    conge_put_number (ctx, (bg & 8 ? 100 : 40) + conge_vt_colors[bg & 7]);
+
+  ctx->_output_buffer[ctx->_output_length++] = 'm';
+
+  ctx->_last_color = color;
+}
+
+/*
+ * Append the parameters selecting a wide color, after the BASE of the
+ * 16-color ones: 30 for foreground, 40 for background. The space must be
+ * reserved.
+ */
+void
+conge_put_wide_color (conge_ctx* ctx, unsigned int color, int base)
+{
+  int index = color & 0xFF;
+
+  if ((color & CONGE_PALETTE (0)) && index < 16)
+    {
+      /* The 16 colors have short sequences of their own. */
+      conge_put_number (ctx, (index & 8 ? base + 60 : base)
+                        + conge_vt_colors[index & 7]);
+      return;
+    }
+
+  conge_put_number (ctx, base + 8);
+
+  if (color & CONGE_PALETTE (0))
+    {
+      conge_put_string (ctx, ";5;");
+      conge_put_number (ctx, index);
+      return;
+    }
+
+  conge_put_string (ctx, ";2;");
+  conge_put_number (ctx, (color >> 16) & 0xFF);
+  ctx->_output_buffer[ctx->_output_length++] = ';';
+  conge_put_number (ctx, (color >> 8) & 0xFF);
+  ctx->_output_buffer[ctx->_output_length++] = ';';
+  conge_put_number (ctx, color & 0xFF);
+}
+
+/*
+ * Change the text colors to FG and BG, if they aren't already. The space
+ * must be reserved.
+ */
+void
+conge_set_wide_color (conge_ctx* ctx, unsigned int fg, unsigned int bg)
+{
+  int fg_changed = fg != ctx->_last_fg, bg_changed = bg != ctx->_last_bg;
+
+  if (!fg_changed && !bg_changed)
+    return;
+
+  CONGE__TRACE (ctx->_presenting->stats.color_changes++);
+
+  conge_put_csi (ctx);
+
+  if (fg_changed)
+    conge_put_wide_color (ctx, fg, 30);
+
+  if (fg_changed && bg_changed)
+    ctx->_output_buffer[ctx->_output_length++] = ';';
+
+  if (bg_changed)
+    conge_put_wide_color (ctx, bg, 40);
+
+  ctx->_output_buffer[ctx->_output_length++] = 'm';
+
+  ctx->_last_fg = fg;
+  ctx->_last_bg = bg;
+}
+
+/*
+ * Send the window title along with the frame if it has changed.
+ */
+void
+conge_update_title (conge_ctx* ctx)
+{
+  const char* title = ctx->_presenting->title;
+  int i;
+
+  if (strncmp (title, ctx->_last_title, sizeof (ctx->_last_title)) == 0)
+    return;
+
+  if (conge_reserve_output (ctx, sizeof (ctx->_last_title) + 8))
+    return;
+
+  strncpy (ctx->_last_title, title, sizeof (ctx->_last_title));
+  ctx->_last_title[sizeof (ctx->_last_title) - 1] = '\0';
+
+  /* OSC 0 sets both the window and the icon title. */
+  ctx->_output_buffer[ctx->_output_length++] = '\033';
+  ctx->_output_buffer[ctx->_output_length++] = ']';
+  ctx->_output_buffer[ctx->_output_length++] = '0';
+  ctx->_output_buffer[ctx->_output_length++] = ';';
+
+  /* Control characters would end the sequence early. */
+  for (i = 0; ctx->_last_title[i] != '\0'; i++)
+    if ((unsigned char) ctx->_last_title[i] >= 32)
+      ctx->_output_buffer[ctx->_output_length++] = ctx->_last_title[i];
+
+  ctx->_output_buffer[ctx->_output_length++] = '\a';
+}
+
+/*
+ * Send the pixels of row Y which changed, between columns MIN and MAX.
+ */
+void
+conge_present_row (conge_ctx* ctx, conge_swap* swap, int y, int min, int max)
+{
+  conge_pixel* front = &swap->pixels[ctx->_buffer_cols * y];
+  conge_pixel* back = &ctx->_backbuffer[ctx->_buffer_cols * y];
+  int x = min;
+
+  /* Compare the front and back buffers, one run of changes at a time. */
+  while ((x = conge_find_pixel (front, back, x, max + 1, 0)) <= max)
+    {
+      int end = conge_find_pixel (front, back, x + 1, max + 1, 1);
+
+      for (; x < end; x++)
+        {
+          /* The color attribute is packed right above the character. */
+          int color = front[x] >> 8;
+
+          /* Out of memory; try again next frame. */
+          if (conge_reserve_output (ctx, CONGE__PIXEL_OUTPUT_MAX))
+            continue;
+
+          /* Encode the pixel at that position. */
+          conge_move_cursor_to (ctx, x, y);
+          conge_set_text_color (ctx, color);
+          conge_put_character (ctx, front[x]);
+          CONGE__TRACE (swap->stats.cells_emitted++);
+
+          /* The console wraps the cursor at the last column. */
+          ctx->_cursor_x = x + 1 < ctx->_buffer_cols ? x + 1 : -1;
+
+          back[x] = front[x];
+        }
+    }
+}
+
+/*
+ * The same for wide pixels.
+ */
+void
+conge_present_wide_row (conge_ctx* ctx, conge_swap* swap, int y,
+                        int min, int max)
+{
+  conge_wide_pixel* front = &swap->wide[ctx->_buffer_cols * y];
+  conge_wide_pixel* back = &ctx->_wide_backbuffer[ctx->_buffer_cols * y];
+  int x = min;
+
+  while ((x = conge_find_wide_pixel (front, back, x, max + 1, 0)) <= max)
+    {
+      int end = conge_find_wide_pixel (front, back, x + 1, max + 1, 1);
+
+      for (; x < end; x++)
+        {
+          if (conge_reserve_output (ctx, CONGE__WIDE_OUTPUT_MAX))
+            continue;
+
+          conge_move_cursor_to (ctx, x, y);
+          conge_set_wide_color (ctx, front[x].fg, front[x].bg);
+          conge_put_wide_character (ctx, &front[x]);
+          CONGE__TRACE (swap->stats.cells_emitted++);
+
+          ctx->_cursor_x = x + 1 < ctx->_buffer_cols ? x + 1 : -1;
+
+          back[x] = front[x];
+        }
+    }
+}
+
+void
+conge_present_swap (conge_ctx* ctx, conge_swap* swap)
+{
+  conge_frame_stats* stats = &swap->stats;
+  int cols = ctx->_buffer_cols, y;
+
+  ctx->_presenting = swap;
+
+  stats->cells_diffed = 0;
+  stats->cells_emitted = 0;
+  stats->cursor_moves = 0;
+  stats->color_changes = 0;
+  stats->bytes = 0;
+  stats->writes = 0;
+
+  CONGE__TRACE (conge_trace_present_begin (ctx, CONGE_PHASE_TITLE));
+  conge_update_title (ctx);
+  CONGE__TRACE (conge_trace_present_end (ctx, CONGE_PHASE_TITLE));
+
+  CONGE__TRACE (conge_trace_present_begin (ctx, CONGE_PHASE_DIFF));
+
+  for (y = 0; y < ctx->_buffer_rows; y++)
+    {
+      conge_span* dirty = &swap->dirty[y];
+      conge_span* stale = &ctx->_stale[y];
+
+      /* Only the pixels drawn now or shown since the last frame changed. */
+      int min = CONGE_MIN (dirty->min, stale->min);
+      int max = CONGE_MAX (dirty->max, stale->max);
+
+      CONGE__TRACE (stats->cells_diffed += CONGE_MAX (0, max - min + 1));
+
+      if (swap->wide != NULL)
+        conge_present_wide_row (ctx, swap, y, min, max);
+      else
+        conge_present_row (ctx, swap, y, min, max);
+
+      /*
+       * The screen is clear apart from these pixels, unless the frame is
+       * retained. The dirty span stays for the buffer to be cleared with.
+       */
+      if (swap->retain)
+        {
+          stale->min = cols;
+          stale->max = -1;
+        }
+      else
+        *stale = *dirty;
+    }
+
+  CONGE__TRACE (conge_trace_present_end (ctx, CONGE_PHASE_DIFF));
+
+  CONGE__TRACE (conge_trace_present_begin (ctx, CONGE_PHASE_FLUSH));
+  conge_flush_output (ctx);
+  CONGE__TRACE (conge_trace_present_end (ctx, CONGE_PHASE_FLUSH));
+}
+
+void
+conge_disable_cursor (conge_ctx* ctx)
+{
+  conge_put_string (ctx, "\033[?25l");
+}
+
+void
+conge_reset_output (conge_ctx* ctx)
+{
+  if (conge_reserve_output (ctx, CONGE__PIXEL_OUTPUT_MAX))
+    return;
+
+  /* Go back to the default colors. */
+  conge_put_csi (ctx);
+  ctx->_output_buffer[ctx->_output_length++] = '0';
+  ctx->_output_buffer[ctx->_output_length++] = 'm';
+
+  ctx->_last_color = -1;
+  ctx->_last_fg = CONGE__NO_COLOR;
+  ctx->_last_bg = CONGE__NO_COLOR;
+
+  conge_move_cursor_to (ctx, 0, 0);
+  conge_flush_output (ctx);
+}
@@ -0,0 +1,595 @@
+/* The POSIX terminal backend, driven by VT escape sequences. */
+
+#include "conge.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+/*
+ * Seconds a key stays down after the terminal reports it: longer than
+ * terminals wait before repeating it, then only as long as between repeats.
+ */
+#define CONGE__KEY_DELAY 0.6
+#define CONGE__KEY_HOLD 0.1
+
+/* Sleeping usually ends within this many seconds; spin for the rest. */
+#define CONGE__SPIN_TIME 0.0002
+
+/* Set by SIGWINCH, so that the window size is only queried after resizes. */
+volatile sig_atomic_t conge_window_resized = 1;
+
+/* US keycaps indexed by scancode, without and with shift held down. */
+const char conge_us_keys[] = "\0\0" "1234567890-=" "\0\0" "qwertyuiop[]"
+  "\0\0" "asdfghjkl;'`" "\0" "\\zxcvbnm,./" "\0\0\0" " ";
+const char conge_us_shift_keys[] = "\0\0" "!@#$%^&*()_+" "\0\0" "QWERTYUIOP{}"
+  "\0\0" "ASDFGHJKL:\"~" "\0" "|ZXCVBNM<>?" "\0\0\0" " ";
+
+void
+conge_handle_resize (int signal)
+{
+  conge_window_resized = 1;
+}
+
+void
+conge_init_console (conge_ctx* ctx)
+{
+  int i;
+
+  ctx->_input = STDIN_FILENO;
+  ctx->_output = STDOUT_FILENO;
+
+  ctx->_raw = 0;
+  ctx->_resize_hooked = 0;
+  ctx->_input_length = 0;
+  ctx->_input_closed = 0;
+
+  for (i = 0; i < 256; i++)
+    ctx->_key_expiry[i] = 0.0;
+}
+
+void
+conge_open_console (conge_ctx* ctx)
+{
+  struct termios raw;
+  struct sigaction action;
+
+  /* Read the keys as they're typed, without echoing or interpreting them. */
+  if (tcgetattr (ctx->_input, &ctx->_termios) == 0)
+    {
+      raw = ctx->_termios;
+
+      raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+      raw.c_oflag &= ~OPOST;
+      raw.c_cflag |= CS8;
+      raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+
+      /* Never block in read. */
+      raw.c_cc[VMIN] = 0;
+      raw.c_cc[VTIME] = 0;
+
+      ctx->_raw = tcsetattr (ctx->_input, TCSAFLUSH, &raw) == 0;
+    }
+
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = conge_handle_resize;
+  sigemptyset (&action.sa_mask);
+
+  /* Writes carry on after a resize; sleeps and waits still end early. */
+  action.sa_flags = SA_RESTART;
+  ctx->_resize_hooked = sigaction (SIGWINCH, &action,
+                                   &ctx->_resize_action) == 0;
+
+  conge_window_resized = 1;
+
+  /* Use the alternate screen, and report all mouse events in SGR format. */
+  conge_put_string (ctx, "\033[?1049h\033[?1003h\033[?1006h");
+}
+
+void
+conge_close_console (conge_ctx* ctx)
+{
+  /* Undo everything conge_open_console and the frames did. */
+  conge_put_string (ctx, "\033[0m\033[?1006l\033[?1003l\033[?25h\033[?1049l");
+  conge_flush_output (ctx);
+
+  ctx->_cursor_x = -1;
+  ctx->_cursor_y = -1;
+  ctx->_last_color = -1;
+  ctx->_last_fg = CONGE__NO_COLOR;
+  ctx->_last_bg = CONGE__NO_COLOR;
+
+  if (ctx->_raw)
+    {
+      tcsetattr (ctx->_input, TCSAFLUSH, &ctx->_termios);
+      ctx->_raw = 0;
+    }
+
+  /* The program might have had a handler of its own. */
+  if (ctx->_resize_hooked)
+    {
+      sigaction (SIGWINCH, &ctx->_resize_action, NULL);
+      ctx->_resize_hooked = 0;
+    }
+}
+
+/*
+ * Update the window size variables.
+ */
+void
+conge_get_window_size (conge_ctx* ctx)
+{
+  struct winsize size;
+
+  if (!conge_window_resized && ctx->cols > 0)
+    return;
+
+  /* The input thread may be reading it too. */
+  __atomic_store_n (&conge_window_resized, 0, __ATOMIC_RELAXED);
+
+  if (ioctl (ctx->_output, TIOCGWINSZ, &size) == 0
+      && size.ws_col > 0 && size.ws_row > 0)
+    {
+      ctx->cols = size.ws_col;
+      ctx->rows = size.ws_row;
+    }
+  else
+    {
+      /* Not a terminal. Trust the environment, or assume the classic size. */
+      const char* cols = getenv ("COLUMNS");
+      const char* rows = getenv ("LINES");
+
+      ctx->cols = cols != NULL && atoi (cols) > 0 ? atoi (cols) : 80;
+      ctx->rows = rows != NULL && atoi (rows) > 0 ? atoi (rows) : 24;
+    }
+}
+
+int
+conge_write_console (conge_ctx* ctx, const char* data, int length)
+{
+  struct pollfd output;
+  int written;
+
+  for (;;)
+    {
+      written = write (ctx->_output, data, length);
+
+      if (written >= 0 || (errno != EINTR && errno != EAGAIN
+                           && errno != EWOULDBLOCK))
+        return written;
+
+      /* A non-blocking output takes more once it's drained a bit. */
+      if (errno != EINTR)
+        {
+          output.fd = ctx->_output;
+          output.events = POLLOUT;
+          poll (&output, 1, -1);
+        }
+    }
+}
+
+double
+conge_console_time (conge_ctx* ctx)
+{
+  struct timespec now;
+
+  /* Unlike the wall clock, this one never jumps. */
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+void
+conge_console_sleep (conge_ctx* ctx, double seconds)
+{
+  double deadline = conge_console_time (ctx) + seconds;
+
+  if (seconds > CONGE__SPIN_TIME)
+    {
+      struct timespec request, remaining;
+
+      seconds -= CONGE__SPIN_TIME;
+      request.tv_sec = seconds;
+      request.tv_nsec = (seconds - request.tv_sec) * 1e9;
+
+      /* Signals such as SIGWINCH interrupt the sleep. */
+      while (nanosleep (&request, &remaining) != 0)
+        request = remaining;
+    }
+
+  while (conge_console_time (ctx) < deadline)
+    ;
+}
+
+void
+conge_console_wait (conge_ctx* ctx, double seconds)
+{
+  struct pollfd input;
+  double now = conge_console_time (ctx), left;
+  int code;
+
+  /*
+   * Input cut off last frame completes, or gets flushed, next frame. The
+   * input thread handles that on its own, and leaves resizes to the main
+   * thread.
+   */
+  if (ctx->_input_queue == NULL
+      && (ctx->_input_length > 0 || conge_window_resized))
+    return;
+
+  /* Nothing is coming, but don't rush through frames either. */
+  if (ctx->_input_closed)
+    {
+      if (seconds > 0.0)
+        conge_console_sleep (ctx, seconds);
+
+      return;
+    }
+
+  /* Held keys are released by timing out, which is a change too. */
+  for (code = 0; code < 256; code++)
+    if (ctx->_key_expiry[code] > 0.0)
+      {
+        left = CONGE_MAX (0.0, ctx->_key_expiry[code] - now);
+
+        if (seconds <= 0.0 || left < seconds)
+          seconds = CONGE_MAX (left, 0.001);
+      }
+
+  input.fd = ctx->_input;
+  input.events = POLLIN;
+
+  /* SIGWINCH interrupts the wait, so resizes get drawn right away. */
+  if (seconds > 0.0)
+    poll (&input, 1, (int) ceil (1000 * CONGE_MIN (seconds, 1e6)));
+  else
+    poll (&input, 1, -1);
+}
+
+/*
+ * Hold the key down until the terminal stops repeating it.
+ */
+void
+conge_press_key (conge_ctx* ctx, int code)
+{
+  conge_event event = { CONGE_EVENT_KEY_DOWN };
+
+  event.code = code;
+  conge_read_event (ctx, &event);
+
+  /* A key still down is being repeated. */
+  ctx->_key_expiry[code] = conge_console_time (ctx)
+    + (ctx->_key_expiry[code] > 0.0 ? CONGE__KEY_HOLD : CONGE__KEY_DELAY);
+}
+
+/*
+ * Report a character typed, apart from the keys it took.
+ */
+void
+conge_type_character (conge_ctx* ctx, unsigned char character)
+{
+  conge_event event = { CONGE_EVENT_CHARACTER };
+
+  event.character = character;
+  conge_read_event (ctx, &event);
+}
+
+/*
+ * Press the key that produces an ASCII character on a US keyboard.
+ */
+void
+conge_press_character (conge_ctx* ctx, unsigned char character)
+{
+  int code;
+
+  for (code = 1; code < sizeof (conge_us_keys); code++)
+    {
+      if (conge_us_keys[code] == character)
+        {
+          conge_press_key (ctx, code);
+          return;
+        }
+
+      if (conge_us_shift_keys[code] == character)
+        {
+          conge_press_key (ctx, CONGE_LSHIFT);
+          conge_press_key (ctx, code);
+          return;
+        }
+    }
+}
+
+/*
+ * Handle a CSI sequence's first parameter and final byte, as sent by the
+ * cursor, editing and function keys.
+ */
+void
+conge_press_sequence (conge_ctx* ctx, int param, char final)
+{
+  /* The same scancodes the Windows console reports for these keys. */
+  switch (final)
+    {
+    case 'A': conge_press_key (ctx, CONGE_KP_8); break;
+    case 'B': conge_press_key (ctx, CONGE_KP_2); break;
+    case 'C': conge_press_key (ctx, CONGE_KP_6); break;
+    case 'D': conge_press_key (ctx, CONGE_KP_4); break;
+    case 'H': conge_press_key (ctx, CONGE_KP_7); break;
+    case 'F': conge_press_key (ctx, CONGE_KP_1); break;
+    case 'P': conge_press_key (ctx, CONGE_F1); break;
+    case 'Q': conge_press_key (ctx, CONGE_F2); break;
+    case 'R': conge_press_key (ctx, CONGE_F3); break;
+    case 'S': conge_press_key (ctx, CONGE_F4); break;
+    case 'Z':
+      conge_press_key (ctx, CONGE_LSHIFT);
+      conge_press_key (ctx, CONGE_TAB);
+      break;
+    case '~':
+      switch (param)
+        {
+        case 1: case 7: conge_press_key (ctx, CONGE_KP_7); break;
+        case 2: conge_press_key (ctx, CONGE_KP_0); break;
+        case 3: conge_press_key (ctx, CONGE_KP_DOT); break;
+        case 4: case 8: conge_press_key (ctx, CONGE_KP_1); break;
+        case 5: conge_press_key (ctx, CONGE_KP_9); break;
+        case 6: conge_press_key (ctx, CONGE_KP_3); break;
+        case 11: case 12: case 13: case 14:
+          conge_press_key (ctx, CONGE_F1 + param - 11);
+          break;
+        case 15: conge_press_key (ctx, CONGE_F5); break;
+        case 17: case 18: case 19: case 20: case 21:
+          conge_press_key (ctx, CONGE_F6 + param - 17);
+          break;
+        }
+      break;
+    }
+}
+
+/*
+ * Handle an SGR mouse report: "\033[<button;x;y" followed by M or m.
+ */
+void
+conge_handle_mouse_report (conge_ctx* ctx, int button, int x, int y,
+                           char final)
+{
+  conge_event event = { CONGE_EVENT_MOUSE_MOVE };
+
+  event.x = x - 1;
+  event.y = y - 1;
+
+  if (button & 64)
+    {
+      event.type = CONGE_EVENT_SCROLL;
+      event.scroll = (button & 3) == 0 ? 1 : -1; /* wheel up is forward */
+    }
+  else if (!(button & 32)) /* motion reports don't change the buttons */
+    {
+      if ((button & 3) == 0)
+        event.code = CONGE_LMB;
+      else if ((button & 3) == 2)
+        event.code = CONGE_RMB;
+
+      /* Other buttons only move the mouse. */
+      if (event.code != 0)
+        event.type = final == 'M' ? CONGE_EVENT_BUTTON_DOWN
+          : CONGE_EVENT_BUTTON_UP;
+    }
+
+  conge_read_event (ctx, &event);
+}
+
+/*
+ * Parse the input bytes into key and mouse events.
+ *
+ * Return the number of bytes handled; the rest is an incomplete escape
+ * sequence. If FINAL is set, a lone escape is the escape key.
+ */
+int
+conge_parse_input (conge_ctx* ctx, const char* data, int length, int final)
+{
+  int i = 0;
+
+  while (i < length)
+    {
+      unsigned char byte = data[i];
+
+      if (byte == '\033')
+        {
+          if (i + 1 >= length)
+            {
+              if (!final)
+                return i;
+
+              conge_press_key (ctx, CONGE_ESC);
+              conge_type_character (ctx, byte);
+              i++;
+            }
+          else if (data[i + 1] == '[' || data[i + 1] == 'O')
+            {
+              int params[3] = { 0, 0, 0 };
+              int count = 0, mouse = 0, end = i + 2;
+
+              if (end < length && data[end] == '<')
+                {
+                  mouse = 1;
+                  end++;
+                }
+
+              /* Collect up to three numeric parameters. */
+              while (end < length && ((data[end] >= '0' && data[end] <= '9')
+                                      || data[end] == ';' || data[end] == ':'))
+                {
+                  if (data[end] == ';' || data[end] == ':')
+                    count++;
+                  else if (count < 3)
+                    params[count] = 10 * params[count] + data[end] - '0';
+
+                  end++;
+                }
+
+              if (end >= length)
+                {
+                  /* Give up on sequences too long to be ours. */
+                  if (!final && length - i < sizeof (ctx->_input_buffer))
+                    return i;
+
+                  i = length;
+                  continue;
+                }
+
+              if (mouse)
+                conge_handle_mouse_report (ctx, params[0], params[1],
+                                           params[2], data[end]);
+              else
+                conge_press_sequence (ctx, params[0], data[end]);
+
+              i = end + 1;
+            }
+          else
+            {
+              /* Escape followed by a key is Alt and that key. */
+              conge_press_key (ctx, CONGE_LALT);
+              i++;
+            }
+
+          continue;
+        }
+
+      if (byte == '\r' || byte == '\n')
+        {
+          conge_press_key (ctx, CONGE_ENTER);
+          byte = '\r';
+        }
+      else if (byte == '\t')
+        conge_press_key (ctx, CONGE_TAB);
+      else if (byte == 127 || byte == '\b')
+        {
+          conge_press_key (ctx, CONGE_BACKSPACE);
+          byte = '\b';
+        }
+      else if (byte == 0)
+        {
+          conge_press_key (ctx, CONGE_LCTRL);
+          conge_press_key (ctx, CONGE_SPACEBAR);
+        }
+      else if (byte <= 26)
+        {
+          /* Control and a letter. */
+          conge_press_key (ctx, CONGE_LCTRL);
+          conge_press_character (ctx, 'a' + byte - 1);
+        }
+      else if (byte < 128)
+        conge_press_character (ctx, byte);
+
+      /* The same characters the Windows console reports. */
+      if (byte != 0 && byte < 128)
+        conge_type_character (ctx, byte);
+
+      i++;
+    }
+
+  return i;
+}
+
+int
+conge_read_console_input (conge_ctx* ctx)
+{
+  char buffer[256];
+  int length, handled, code;
+  double now = conge_console_time (ctx);
+  struct pollfd input;
+
+  /* A resize is worth waking an idle main thread up for. */
+  int read_any = __atomic_load_n (&conge_window_resized, __ATOMIC_RELAXED);
+
+  /* Release the keys the terminal stopped repeating. */
+  for (code = 0; code < 256; code++)
+    if (ctx->_key_expiry[code] > 0.0 && ctx->_key_expiry[code] <= now)
+      {
+        conge_event event = { CONGE_EVENT_KEY_UP };
+
+        event.code = code;
+        conge_read_event (ctx, &event);
+
+        ctx->_key_expiry[code] = 0.0;
+        read_any = 1;
+      }
+
+  input.fd = ctx->_input;
+  input.events = POLLIN;
+
+  /* Start with the leftovers from the previous read. */
+  length = ctx->_input_length;
+  memcpy (buffer, ctx->_input_buffer, length);
+
+  while (poll (&input, 1, 0) > 0 && (input.revents & (POLLIN | POLLHUP)))
+    {
+      int count = read (ctx->_input, buffer + length,
+                        sizeof (buffer) - length);
+
+      /* Reading nothing from a ready terminal means it hung up. */
+      if (count <= 0)
+        {
+          if (count == 0 && !ctx->_input_closed)
+            ctx->_input_closed = read_any = 1;
+
+          break;
+        }
+
+      length += count;
+      handled = conge_parse_input (ctx, buffer, length, 0);
+
+      memmove (buffer, buffer + handled, length - handled);
+      length -= handled;
+      read_any = 1;
+    }
+
+  /* Whatever is still incomplete after a whole read won't ever complete. */
+  if (length > 0 && length == ctx->_input_length)
+    {
+      length -= conge_parse_input (ctx, buffer, length, 1);
+      read_any = 1;
+    }
+
+  ctx->_input_length = length;
+  memcpy (ctx->_input_buffer, buffer, length);
+
+  return read_any;
+}
+
+void
+conge_handle_console_input (conge_ctx* ctx)
+{
+  int prev_x = ctx->mouse_x, prev_y = ctx->mouse_y;
+
+  conge_take_input (ctx);
+
+  /* Terminals can't warp the pointer, so report its movement in cells. */
+  if (ctx->grab)
+    {
+      ctx->mouse_dx = ctx->mouse_x - prev_x;
+      ctx->mouse_dy = ctx->mouse_y - prev_y;
+    }
+  else
+    {
+      ctx->mouse_dx = 0;
+      ctx->mouse_dy = 0;
+    }
+}
+
+const conge_backend conge_console_backend =
+  {
+    conge_open_console,
+    conge_close_console,
+    conge_get_window_size,
+    conge_handle_console_input,
+    conge_read_console_input,
+    conge_write_console,
+    conge_console_time,
+    conge_console_sleep,
+    conge_console_wait,
+  };
+
+#endif /* !_WIN32 */
@@ -0,0 +1,262 @@
+/* The swap chain, and the thread presenting it. */
+
+#include "conge.h"
+
+/*
+ * The presenter thread's state. Frame N goes into swap N modulo the chain
+ * length; the main thread only ever adds to CTX->_frames_submitted and the
+ * presenter to CTX->_frames_presented, so handing a buffer over is a single
+ * atomic add. The mutex is only taken by a thread about to sleep for the
+ * other one, and by the other one if it sees that WAITING is set.
+ */
+struct conge_presenter
+{
+  conge_thread thread;
+  volatile long quit;
+  volatile long waiting; /* the threads sleeping, or about to */
+  conge_mutex mutex;
+  conge_cond changed; /* either counter, or QUIT */
+};
+
+/*
+ * Return nonzero if a frame awaits the presenter, or it has to quit.
+ */
+int
+conge_frame_pending (conge_ctx* ctx)
+{
+  return conge_atomic_load (&ctx->_frames_submitted)
+    != conge_atomic_load (&ctx->_frames_presented)
+    || conge_atomic_load (&ctx->_presenter->quit);
+}
+
+/*
+ * Return nonzero if the next frame's buffer isn't being presented.
+ */
+int
+conge_swap_free (conge_ctx* ctx)
+{
+  return conge_atomic_load (&ctx->_frames_submitted)
+    - conge_atomic_load (&ctx->_frames_presented) < ctx->_swap_count;
+}
+
+/*
+ * Return nonzero if every frame submitted has been presented.
+ */
+int
+conge_frames_presented (conge_ctx* ctx)
+{
+  return conge_atomic_load (&ctx->_frames_submitted)
+    == conge_atomic_load (&ctx->_frames_presented);
+}
+
+/*
+ * Sleep until READY returns nonzero, unless it already does.
+ */
+void
+conge_presenter_wait (conge_ctx* ctx, int (*ready) (conge_ctx*))
+{
+  conge_presenter* presenter = ctx->_presenter;
+
+  if (ready (ctx))
+    return;
+
+  /* Announce the wait before checking again, so that no wakeup is lost. */
+  conge_atomic_add (&presenter->waiting, 1);
+  conge_mutex_lock (&presenter->mutex);
+
+  while (!ready (ctx))
+    conge_cond_wait (&presenter->changed, &presenter->mutex);
+
+  conge_mutex_unlock (&presenter->mutex);
+  conge_atomic_add (&presenter->waiting, -1);
+}
+
+/*
+ * Wake up the other thread after changing a counter, if it's waiting.
+ */
+void
+conge_presenter_signal (conge_presenter* presenter)
+{
+  /* An add rather than a load, for its full barrier. */
+  if (conge_atomic_add (&presenter->waiting, 0) == 0)
+    return;
+
+  conge_mutex_lock (&presenter->mutex);
+  conge_cond_broadcast (&presenter->changed);
+  conge_mutex_unlock (&presenter->mutex);
+}
+
+void
+conge_presenter_thread (void* data)
+{
+  conge_ctx* ctx = data;
+  conge_presenter* presenter = ctx->_presenter;
+  long frame;
+
+  for (;;)
+    {
+      double start;
+
+      conge_presenter_wait (ctx, conge_frame_pending);
+
+      /* Frames are all presented before quitting. */
+      frame = conge_atomic_load (&ctx->_frames_presented);
+
+      if (frame == conge_atomic_load (&ctx->_frames_submitted))
+        break;
+
+      start = conge_console_time (ctx);
+      conge_present_swap (ctx, &ctx->_swaps[frame % ctx->_swap_count]);
+      ctx->_presenting->present_time = conge_console_time (ctx) - start;
+
+      conge_atomic_add (&ctx->_frames_presented, 1);
+      conge_presenter_signal (presenter);
+    }
+}
+
+conge_swap*
+conge_acquire_swap (conge_ctx* ctx)
+{
+  if (ctx->_presenter != NULL)
+    conge_presenter_wait (ctx, conge_swap_free);
+
+  return &ctx->_swaps[ctx->_frames_submitted % ctx->_swap_count];
+}
+
+void
+conge_finish_presenting (conge_ctx* ctx)
+{
+  if (ctx->_presenter != NULL)
+    conge_presenter_wait (ctx, conge_frames_presented);
+}
+
+void
+conge_draw_frame (conge_ctx* ctx)
+{
+  conge_swap* swap = &ctx->_swaps[ctx->_frames_submitted % ctx->_swap_count];
+  double start;
+
+  conge_composite_layers (ctx);
+  conge_pack_subpixels (ctx);
+
+  memcpy (swap->title, ctx->title, sizeof (swap->title));
+  swap->retain = conge_frame_retained (ctx);
+  swap->traced = ctx->_trace != NULL;
+
+  if (ctx->_presenter != NULL && ctx->_swap_count > 1)
+    {
+      /*
+       * The presenter is done with this buffer, so what it measured last
+       * time is the latest frame the main thread can safely look at.
+       */
+      ctx->frame_bytes = swap->stats.bytes;
+      ctx->frame_writes = swap->stats.writes;
+      ctx->present_time = swap->present_time;
+      CONGE__TRACE (conge_trace_presented (ctx, swap, 1));
+
+      conge_atomic_add (&ctx->_frames_submitted, 1);
+      conge_presenter_signal (ctx->_presenter);
+      return;
+    }
+
+  start = ctx->_backend->now (ctx);
+  conge_present_swap (ctx, swap);
+  ctx->present_time = ctx->_backend->now (ctx) - start;
+
+  /* Keep count all the same, for when a presenter starts. */
+  conge_atomic_add (&ctx->_frames_submitted, 1);
+  conge_atomic_add (&ctx->_frames_presented, 1);
+
+  ctx->frame_bytes = swap->stats.bytes;
+  ctx->frame_writes = swap->stats.writes;
+  CONGE__TRACE (conge_trace_presented (ctx, swap, 0));
+}
+
+int
+conge_start_presenter (conge_ctx* ctx)
+{
+  conge_presenter* presenter;
+
+  if (ctx->_presenter != NULL)
+    return 0;
+
+  presenter = malloc (sizeof (*presenter));
+
+  if (presenter == NULL)
+    return 1;
+
+  presenter->quit = 0;
+  presenter->waiting = 0;
+
+  if (conge_mutex_init (&presenter->mutex))
+    {
+      free (presenter);
+      return 1;
+    }
+
+  if (conge_cond_init (&presenter->changed))
+    {
+      conge_mutex_destroy (&presenter->mutex);
+      free (presenter);
+      return 1;
+    }
+
+  /* Set before the thread starts, so that it knows what to wait on. */
+  ctx->_presenter = presenter;
+
+  if (conge_thread_start (&presenter->thread, conge_presenter_thread, ctx))
+    {
+      ctx->_presenter = NULL;
+      conge_cond_destroy (&presenter->changed);
+      conge_mutex_destroy (&presenter->mutex);
+      free (presenter);
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+conge_stop_presenter (conge_ctx* ctx)
+{
+  conge_presenter* presenter = ctx->_presenter;
+
+  if (presenter == NULL)
+    return;
+
+  conge_atomic_store (&presenter->quit, 1);
+  conge_presenter_signal (presenter);
+  conge_thread_join (&presenter->thread);
+
+  ctx->_presenter = NULL;
+
+  conge_cond_destroy (&presenter->changed);
+  conge_mutex_destroy (&presenter->mutex);
+  free (presenter);
+}
+
+int
+conge_set_swap_chain (conge_ctx* ctx, int buffers)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (buffers < 1 || buffers > CONGE_MAX_SWAPS)
+    return 2;
+
+  ctx->_swaps_wanted = buffers;
+
+  if (buffers == 1)
+    {
+      conge_stop_presenter (ctx);
+      return 0;
+    }
+
+  if (conge_start_presenter (ctx))
+    {
+      ctx->_swaps_wanted = 1;
+      return 3;
+    }
+
+  return 0;
+}
@@ -0,0 +1,822 @@
+/* Rasterizers: integer-only, clipped before they touch the pixels. */
+
+#include "conge.h"
+
+/*
+ * Lines whose extent along either axis reaches this many pixels are first
+ * shortened, so that the stepping arithmetic can't overflow.
+ */
+#define CONGE__LINE_LIMIT (1 << 29)
+
+/*
+ * Triangles with vertices this far from the origin have their edges solved
+ * in floating point, as the exact products could overflow.
+ */
+#define CONGE__TRIANGLE_LIMIT (1 << 29)
+
+/*
+ * A triangle edge from (X; Y), whose inside is where
+ * A * (x - X) + B * (y - Y) >= BIAS.
+ */
+typedef struct conge_edge conge_edge;
+struct conge_edge
+{
+  long long a, b;
+  int x, y;
+  int bias; /* 0 if the pixels right on the edge belong to the triangle */
+};
+
+void
+conge_frame_target (conge_ctx* ctx, conge_target* target)
+{
+  target->pixels = ctx->frame;
+  target->wide = ctx->wide_frame;
+  target->colors = NULL;
+  target->stride = ctx->cols;
+
+  target->clip_x0 = 0;
+  target->clip_y0 = 0;
+  target->clip_x1 = ctx->cols - 1;
+  target->clip_y1 = ctx->rows - 1;
+
+  target->dirty = ctx->_dirty;
+}
+
+/*
+ * Extend row Y's dirty span, if the target tracks them.
+ */
+void
+conge_mark_target (const conge_target* target, int y, int x0, int x1)
+{
+  conge_span* span;
+
+  if (target->dirty == NULL)
+    return;
+
+  span = &target->dirty[y];
+
+  if (x0 < span->min)
+    span->min = x0;
+
+  if (x1 > span->max)
+    span->max = x1;
+}
+
+void
+conge_narrow_cell (const conge_target* target, conge_pixel pixel,
+                   conge_cell* cell)
+{
+  cell->pixel = pixel;
+
+  if (target->wide != NULL)
+    cell->wide = conge_widen_pixel (pixel);
+}
+
+void
+conge_wide_cell (const conge_target* target, conge_wide_pixel wide,
+                 conge_cell* cell)
+{
+  cell->wide = wide;
+
+  if (target->wide == NULL)
+    cell->pixel = conge_narrow_pixel (wide);
+}
+
+void
+conge_fill_pixels (conge_pixel* pixels, int count, conge_pixel fill)
+{
+  int i;
+
+  /* Blank cells usually repeat the same byte. */
+  if ((fill & 0xFF) == (fill >> 8))
+    {
+      memset (pixels, fill & 0xFF, count * sizeof (*pixels));
+      return;
+    }
+
+  for (i = 0; i < count; i++)
+    pixels[i] = fill;
+}
+
+void
+conge_fill_wide_pixels (conge_wide_pixel* pixels, int count,
+                        conge_wide_pixel fill)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    pixels[i] = fill;
+}
+
+void
+conge_fill_colors (unsigned int* colors, int count, unsigned int fill)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    colors[i] = fill;
+}
+
+/*
+ * Fill the columns X0 to X1 of row Y, which must be within the target,
+ * whatever its format.
+ */
+void
+conge_fill_target (const conge_target* target, int y, int x0, int x1,
+                   const conge_cell* fill)
+{
+  long offset = (long) target->stride * y + x0;
+
+  if (target->wide != NULL)
+    conge_fill_wide_pixels (&target->wide[offset], x1 - x0 + 1, fill->wide);
+  else if (target->colors != NULL)
+    conge_fill_colors (&target->colors[offset], x1 - x0 + 1, fill->color);
+  else
+    conge_fill_pixels (&target->pixels[offset], x1 - x0 + 1, fill->pixel);
+}
+
+void
+conge_raster_span (const conge_target* target, int y, int x0, int x1,
+                   const conge_cell* fill)
+{
+  if (y < target->clip_y0 || y > target->clip_y1)
+    return;
+
+  x0 = CONGE_MAX (x0, target->clip_x0);
+  x1 = CONGE_MIN (x1, target->clip_x1);
+
+  if (x0 > x1)
+    return;
+
+  conge_fill_target (target, y, x0, x1, fill);
+  conge_mark_target (target, y, x0, x1);
+}
+
+void
+conge_raster_rect (const conge_target* target, int x, int y, int w, int h,
+                   const conge_cell* fill)
+{
+  int x0 = CONGE_MAX (x, target->clip_x0);
+  int y0 = CONGE_MAX (y, target->clip_y0);
+  int x1 = CONGE_MIN ((long long) x + w - 1, target->clip_x1);
+  int y1 = CONGE_MIN ((long long) y + h - 1, target->clip_y1);
+
+  for (y = y0; y <= y1 && x0 <= x1; y++)
+    {
+      conge_fill_target (target, y, x0, x1, fill);
+      conge_mark_target (target, y, x0, x1);
+    }
+}
+
+void
+conge_raster_string (const conge_target* target, const char* string,
+                     int length, int x, int y, int fg, int bg)
+{
+  conge_pixel *row, color, keep;
+  int i, start, end;
+
+  if (y < target->clip_y0 || y > target->clip_y1)
+    return;
+
+  /* Only the part of the string within the clip rectangle is written. */
+  start = CONGE_MAX (0, (long long) target->clip_x0 - x);
+  end = CONGE_MIN (length, (long long) target->clip_x1 + 1 - x);
+
+  if (start >= end)
+    return;
+
+  conge_mark_target (target, y, x + start, x + end - 1);
+
+  if (target->wide != NULL)
+    {
+      conge_wide_pixel* wide = &target->wide[(long) target->stride * y + x];
+
+      for (i = start; i < end; i++)
+        {
+          /* The same characters as conge_set_character takes. */
+          if (string[i] >= 32)
+            wide[i].character = string[i];
+
+          if (fg >= 0 && fg < 16)
+            wide[i].fg = CONGE_PALETTE (fg);
+
+          if (bg >= 0 && bg < 16)
+            wide[i].bg = CONGE_PALETTE (bg);
+        }
+
+      return;
+    }
+
+  /*
+   * Pack the colors once, as conge_set_fg and conge_set_bg would; the ones
+   * out of range keep the bits of the pixels written over.
+   */
+  color = 0;
+  keep = 0xFF;
+
+  if (fg >= 0 && fg < 16)
+    color |= fg << 8;
+  else
+    keep |= 0x0F00;
+
+  if (bg >= 0 && bg < 16)
+    color |= bg << 12;
+  else
+    keep |= 0xF000;
+
+  row = &target->pixels[(long) target->stride * y + x];
+
+  if (keep == 0xFF)
+    for (i = start; i < end; i++)
+      row[i] = string[i] >= 32 ? (unsigned char) string[i] | color
+        : (row[i] & 0xFF) | color;
+  else
+    for (i = start; i < end; i++)
+      row[i] = string[i] >= 32
+        ? (unsigned char) string[i] | color | (row[i] & keep & 0xFF00)
+        : (row[i] & keep) | color;
+}
+
+const char*
+conge_decode_utf8 (const char* string, const char* end,
+                   unsigned int* character)
+{
+  const unsigned char* bytes = (const unsigned char*) string;
+  unsigned int code;
+  int count, i;
+
+  if (bytes[0] < 0x80)
+    count = 0;
+  else if (bytes[0] >= 0xC2 && bytes[0] <= 0xDF)
+    count = 1;
+  else if (bytes[0] >= 0xE0 && bytes[0] <= 0xEF)
+    count = 2;
+  else if (bytes[0] >= 0xF0 && bytes[0] <= 0xF4)
+    count = 3;
+  else
+    count = -1;
+
+  *character = bytes[0];
+
+  if (count <= 0 || end - string <= count)
+    return string + 1;
+
+  code = bytes[0] & (0x3F >> count);
+
+  for (i = 1; i <= count; i++)
+    {
+      if ((bytes[i] & 0xC0) != 0x80)
+        return string + 1;
+
+      code = code << 6 | (bytes[i] & 0x3F);
+    }
+
+  /* Overlong forms, surrogates and the like aren't characters. */
+  if ((count == 2 && code < 0x800) || (code >= 0xD800 && code <= 0xDFFF)
+      || code > 0x10FFFF || (count == 3 && code < 0x10000))
+    return string + 1;
+
+  *character = code;
+  return string + count + 1;
+}
+
+void
+conge_raster_wide_string (const conge_target* target, const char* string,
+                          int length, int x, int y,
+                          unsigned int fg, unsigned int bg)
+{
+  const char* end = string + length;
+  conge_wide_pixel pixel, *wide = NULL;
+  conge_pixel color = 0, *row = NULL;
+  int start = -1;
+
+  if (y < target->clip_y0 || y > target->clip_y1)
+    return;
+
+  pixel.fg = fg;
+  pixel.bg = bg;
+
+  /* The colors are converted for a narrow target once, not per pixel. */
+  if (target->wide != NULL)
+    wide = &target->wide[(long) target->stride * y];
+  else
+    {
+      row = &target->pixels[(long) target->stride * y];
+      color = conge_narrow_pixel (conge_new_wide_pixel (' ', fg, bg)) & 0xFF00;
+    }
+
+  /* Each character takes a column, however many bytes it has. */
+  for (; string < end && x <= target->clip_x1; x++)
+    {
+      string = conge_decode_utf8 (string, end, &pixel.character);
+
+      if (x < target->clip_x0 || pixel.character < 32
+          || pixel.character == 127)
+        continue;
+
+      if (start < 0)
+        start = x;
+
+      if (wide != NULL)
+        wide[x] = pixel;
+      else
+        row[x] = (pixel.character < 256 ? pixel.character : '?') | color;
+    }
+
+  if (start >= 0)
+    conge_mark_target (target, y, start, x - 1);
+}
+
+int
+conge_string_length (const char* string, long long limit)
+{
+  int length = 0;
+
+  while (length < limit && string[length] != '\0')
+    length++;
+
+  return length;
+}
+
+void
+conge_blit_row (const conge_target* target, long offset,
+                const conge_pixel* from, int count, conge_pixel key,
+                int flags)
+{
+  int reverse = flags & CONGE_FLIP_X, opaque = flags & CONGE_OPAQUE, i;
+  conge_pixel* to = &target->pixels[offset];
+
+  if (target->wide != NULL)
+    {
+      for (i = 0; i < count; i++)
+        {
+          conge_pixel pixel = reverse ? from[-i] : from[i];
+
+          if (opaque || pixel != key)
+            target->wide[offset + i] = conge_widen_pixel (pixel);
+        }
+    }
+  else if (opaque && !reverse)
+    memcpy (to, from, count * sizeof (*from));
+  else if (opaque)
+    for (i = 0; i < count; i++)
+      to[i] = from[-i];
+  else if (count < 8 && !reverse)
+    {
+      /* Too short for vectors; don't bother calling them. */
+      for (i = 0; i < count; i++)
+        if (from[i] != key)
+          to[i] = from[i];
+    }
+  else
+    conge_blit_pixels (to, from, count, key, reverse);
+}
+
+void
+conge_blit_wide_row (const conge_target* target, long offset,
+                     const conge_wide_pixel* from, int count, int flags)
+{
+  int reverse = flags & CONGE_FLIP_X, opaque = flags & CONGE_OPAQUE, i;
+
+  if (target->wide != NULL && opaque && !reverse)
+    {
+      memcpy (&target->wide[offset], from, count * sizeof (*from));
+      return;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      const conge_wide_pixel* pixel = reverse ? &from[-i] : &from[i];
+
+      if (!opaque && pixel->character == 0)
+        continue;
+
+      if (target->wide != NULL)
+        target->wide[offset + i] = *pixel;
+      else
+        target->pixels[offset + i] = conge_narrow_pixel (*pixel);
+    }
+}
+
+void
+conge_raster_blit (const conge_target* target, const conge_target* source,
+                   conge_pixel key, int sx, int sy, int w, int h, int x, int y,
+                   int flags)
+{
+  int x0 = CONGE_MAX (x, target->clip_x0);
+  int y0 = CONGE_MAX (y, target->clip_y0);
+  int x1 = CONGE_MIN ((long long) x + w - 1, target->clip_x1);
+  int y1 = CONGE_MIN ((long long) y + h - 1, target->clip_y1);
+  int column, row;
+
+  if (x0 > x1 || y0 > y1)
+    return;
+
+  /* The source's column drawn at X0; flipped rows are read backwards. */
+  column = sx + (flags & CONGE_FLIP_X ? x + w - 1 - x0 : x0 - x);
+
+  for (row = y0; row <= y1; row++)
+    {
+      int from_row = sy + (flags & CONGE_FLIP_Y ? y + h - 1 - row : row - y);
+      long from = (long) source->stride * from_row + column;
+      long offset = (long) target->stride * row + x0;
+
+      if (source->wide != NULL)
+        conge_blit_wide_row (target, offset, &source->wide[from],
+                             x1 - x0 + 1, flags);
+      else
+        conge_blit_row (target, offset, &source->pixels[from], x1 - x0 + 1,
+                        key, flags);
+
+      conge_mark_target (target, row, x0, x1);
+    }
+}
+
+/*
+ * Set the pixel at OFFSET, whatever the target's format.
+ */
+void
+conge_put_pixel (const conge_target* target, long offset,
+                 const conge_cell* fill)
+{
+  if (target->wide != NULL)
+    target->wide[offset] = fill->wide;
+  else if (target->colors != NULL)
+    target->colors[offset] = fill->color;
+  else
+    target->pixels[offset] = fill->pixel;
+}
+
+/*
+ * Fill column X from row Y0 to row Y1, clipped.
+ */
+void
+conge_raster_column (const conge_target* target, int x, int y0, int y1,
+                     const conge_cell* fill)
+{
+  long offset;
+  int y;
+
+  if (x < target->clip_x0 || x > target->clip_x1)
+    return;
+
+  y0 = CONGE_MAX (y0, target->clip_y0);
+  y1 = CONGE_MIN (y1, target->clip_y1);
+
+  offset = (long) target->stride * y0 + x;
+
+  for (y = y0; y <= y1; y++)
+    {
+      conge_put_pixel (target, offset, fill);
+      offset += target->stride;
+
+      conge_mark_target (target, y, x, x);
+    }
+}
+
+/*
+ * Cut the line down to the part within a pixel of the clip rectangle
+ * (Liang-Barsky). Return 1 if nothing is left.
+ *
+ * Only very long lines come here, so rounding the new ends is harmless.
+ */
+int
+conge_shorten_line (const conge_target* target, int* x0, int* y0,
+                    int* x1, int* y1)
+{
+  double dx = (double) *x1 - *x0, dy = (double) *y1 - *y0;
+  double t0 = 0.0, t1 = 1.0;
+  double p[4], q[4];
+  int i;
+
+  p[0] = -dx;
+  q[0] = *x0 - (target->clip_x0 - 1.0);
+  p[1] = dx;
+  q[1] = (target->clip_x1 + 1.0) - *x0;
+  p[2] = -dy;
+  q[2] = *y0 - (target->clip_y0 - 1.0);
+  p[3] = dy;
+  q[3] = (target->clip_y1 + 1.0) - *y0;
+
+  for (i = 0; i < 4; i++)
+    {
+      double t;
+
+      if (p[i] == 0.0)
+        {
+          if (q[i] < 0.0)
+            return 1;
+
+          continue;
+        }
+
+      t = q[i] / p[i];
+
+      if (p[i] < 0.0 && t > t0)
+        t0 = t;
+      else if (p[i] > 0.0 && t < t1)
+        t1 = t;
+    }
+
+  if (t0 > t1)
+    return 1;
+
+  *x1 = floor (*x0 + t1 * dx + 0.5);
+  *y1 = floor (*y0 + t1 * dy + 0.5);
+  *x0 = floor (*x0 + t0 * dx + 0.5);
+  *y0 = floor (*y0 + t0 * dy + 0.5);
+
+  return 0;
+}
+
+void
+conge_raster_line (const conge_target* target, int x0, int y0, int x1, int y1,
+                   const conge_cell* fill)
+{
+  long long n, d, remainder, first, last;
+  int x_major, minor_sign, major_start, minor_start, count, i;
+  int run_start, run_row;
+  long offset;
+
+  if (target->clip_x0 > target->clip_x1 || target->clip_y0 > target->clip_y1)
+    return;
+
+  /* Lines entirely on one side of the clip rectangle are never visited. */
+  if (CONGE_MAX (x0, x1) < target->clip_x0
+      || CONGE_MIN (x0, x1) > target->clip_x1
+      || CONGE_MAX (y0, y1) < target->clip_y0
+      || CONGE_MIN (y0, y1) > target->clip_y1)
+    return;
+
+  if (y0 == y1)
+    {
+      conge_raster_span (target, y0, CONGE_MIN (x0, x1), CONGE_MAX (x0, x1),
+                         fill);
+      return;
+    }
+
+  if (x0 == x1)
+    {
+      conge_raster_column (target, x0, CONGE_MIN (y0, y1), CONGE_MAX (y0, y1),
+                           fill);
+      return;
+    }
+
+  n = (long long) x1 - x0;
+  d = (long long) y1 - y0;
+
+  if (n <= -CONGE__LINE_LIMIT || n >= CONGE__LINE_LIMIT
+      || d <= -CONGE__LINE_LIMIT || d >= CONGE__LINE_LIMIT)
+    {
+      if (!conge_shorten_line (target, &x0, &y0, &x1, &y1))
+        conge_raster_line (target, x0, y0, x1, y1, fill);
+
+      return;
+    }
+
+  n = n < 0 ? -n : n;
+  d = d < 0 ? -d : d;
+  x_major = n >= d;
+
+  /*
+   * Always step forward along the major axis, so that both directions
+   * draw the same pixels.
+   */
+  if (x_major ? x1 < x0 : y1 < y0)
+    {
+      int swap;
+
+      swap = x0, x0 = x1, x1 = swap;
+      swap = y0, y0 = y1, y1 = swap;
+    }
+
+  if (!x_major)
+    {
+      long long swap = n;
+      n = d, d = swap;
+    }
+
+  /*
+   * Pixel I (0 to N) lies I steps along the major axis, and
+   * floor ((2 * I * D + N) / (2 * N)) steps along the minor one. Both only
+   * grow, so clipping turns into a range of I.
+   */
+  {
+    int major_from = x_major ? x0 : y0;
+    int minor_from = x_major ? y0 : x0;
+    int minor_to = x_major ? y1 : x1;
+    int clip_major0 = x_major ? target->clip_x0 : target->clip_y0;
+    int clip_major1 = x_major ? target->clip_x1 : target->clip_y1;
+    int clip_minor0 = x_major ? target->clip_y0 : target->clip_x0;
+    int clip_minor1 = x_major ? target->clip_y1 : target->clip_x1;
+    long long low, high;
+
+    minor_sign = minor_to < minor_from ? -1 : 1;
+
+    first = CONGE_MAX (0, (long long) clip_major0 - major_from);
+    last = CONGE_MIN (n, (long long) clip_major1 - major_from);
+
+    /* The minor offsets allowed by the clip rectangle. */
+    if (minor_sign > 0)
+      {
+        low = (long long) clip_minor0 - minor_from;
+        high = (long long) clip_minor1 - minor_from;
+      }
+    else
+      {
+        low = (long long) minor_from - clip_minor1;
+        high = (long long) minor_from - clip_minor0;
+      }
+
+    if (low > 0)
+      first = CONGE_MAX (first, (2 * n * low - n + 2 * d - 1) / (2 * d));
+
+    if (high < d)
+      last = CONGE_MIN (last, (2 * n * (high + 1) - n - 1) / (2 * d));
+
+    if (first > last)
+      return;
+
+    major_start = major_from + (int) first;
+    minor_start = minor_from
+      + minor_sign * (int) ((2 * first * d + n) / (2 * n));
+    remainder = (2 * first * d + n) % (2 * n);
+    count = (int) (last - first) + 1;
+  }
+
+  /* Runs along a row are filled and marked dirty all at once. */
+  run_start = major_start;
+  run_row = minor_start;
+
+  /* Only steep lines use it, stepping down the rows a pixel at a time. */
+  offset = x_major ? (long) target->stride * minor_start + major_start
+    : (long) target->stride * major_start + minor_start;
+
+  for (i = 0; i < count; i++)
+    {
+      if (!x_major)
+        {
+          conge_put_pixel (target, offset, fill);
+          conge_mark_target (target, major_start + i, minor_start,
+                             minor_start);
+
+          offset += target->stride;
+        }
+
+      remainder += 2 * d;
+
+      if (remainder >= 2 * n)
+        {
+          remainder -= 2 * n;
+
+          if (x_major)
+            {
+              conge_fill_target (target, run_row, run_start, major_start + i,
+                                 fill);
+              conge_mark_target (target, run_row, run_start, major_start + i);
+              run_start = major_start + i + 1;
+              run_row += minor_sign;
+            }
+          else
+            {
+              minor_start += minor_sign;
+              offset += minor_sign;
+            }
+        }
+    }
+
+  if (x_major && run_start < major_start + count)
+    {
+      conge_fill_target (target, run_row, run_start, major_start + count - 1,
+                         fill);
+      conge_mark_target (target, run_row, run_start, major_start + count - 1);
+    }
+}
+
+/*
+ * Set up the edge from (X0; Y0) to (X1; Y1) of a counter-clockwise triangle.
+ */
+void
+conge_setup_edge (conge_edge* edge, int x0, int y0, int x1, int y1)
+{
+  edge->a = (long long) y1 - y0;
+  edge->b = (long long) x0 - x1;
+  edge->x = x0;
+  edge->y = y0;
+
+  /*
+   * The top-left rule: a pixel on an edge shared by two triangles goes to
+   * exactly one of them, as the edge runs in opposite directions in each.
+   */
+  edge->bias = edge->a > 0 || (edge->a == 0 && edge->b > 0) ? 0 : 1;
+}
+
+/*
+ * Floor division by a positive number.
+ */
+long long
+conge_floor_div (long long numerator, long long denominator)
+{
+  if (numerator >= 0)
+    return numerator / denominator;
+
+  return -((-numerator + denominator - 1) / denominator);
+}
+
+/*
+ * Narrow the columns FROM to TO of row Y to the ones inside EDGE.
+ */
+void
+conge_clip_to_edge (const conge_edge* edge, int y, int exact,
+                    int* from, int* to)
+{
+  long long bound;
+
+  if (exact)
+    {
+      long long rest = edge->bias - edge->b * ((long long) y - edge->y);
+
+      if (edge->a > 0)
+        bound = edge->x - conge_floor_div (-rest, edge->a);
+      else if (edge->a < 0)
+        bound = edge->x + conge_floor_div (-rest, -edge->a);
+      else
+        bound = rest > 0 ? -1 : 0;
+    }
+  else
+    {
+      double rest = edge->bias - (double) edge->b * ((double) y - edge->y);
+
+      if (edge->a != 0)
+        {
+          double x = edge->x + rest / edge->a;
+
+          /* Keep the conversion within range. */
+          x = CONGE_MAX (*from - 1.0, CONGE_MIN (x, *to + 1.0));
+          bound = edge->a > 0 ? ceil (x) : floor (x);
+        }
+      else
+        bound = rest > 0 ? -1 : 0;
+    }
+
+  if (edge->a > 0)
+    *from = CONGE_MAX (*from, bound);
+  else if (edge->a < 0)
+    *to = CONGE_MIN (*to, bound);
+  else if (bound < 0)
+    *to = *from - 1; /* the whole row is outside */
+}
+
+void
+conge_raster_triangle (const conge_target* target, int x0, int y0,
+                       int x1, int y1, int x2, int y2, const conge_cell* fill)
+{
+  conge_edge edges[3];
+  int left, top, right, bottom;
+  int exact, y;
+
+  left = CONGE_MAX (target->clip_x0, CONGE_MIN (x0, CONGE_MIN (x1, x2)));
+  top = CONGE_MAX (target->clip_y0, CONGE_MIN (y0, CONGE_MIN (y1, y2)));
+  right = CONGE_MIN (target->clip_x1, CONGE_MAX (x0, CONGE_MAX (x1, x2)));
+  bottom = CONGE_MIN (target->clip_y1, CONGE_MAX (y0, CONGE_MAX (y1, y2)));
+
+  if (left > right || top > bottom)
+    return;
+
+  exact = 1;
+
+  if (x0 <= -CONGE__TRIANGLE_LIMIT || x0 >= CONGE__TRIANGLE_LIMIT
+      || y0 <= -CONGE__TRIANGLE_LIMIT || y0 >= CONGE__TRIANGLE_LIMIT
+      || x1 <= -CONGE__TRIANGLE_LIMIT || x1 >= CONGE__TRIANGLE_LIMIT
+      || y1 <= -CONGE__TRIANGLE_LIMIT || y1 >= CONGE__TRIANGLE_LIMIT
+      || x2 <= -CONGE__TRIANGLE_LIMIT || x2 >= CONGE__TRIANGLE_LIMIT
+      || y2 <= -CONGE__TRIANGLE_LIMIT || y2 >= CONGE__TRIANGLE_LIMIT)
+    exact = 0;
+
+  /* Clockwise and flat triangles have no inside. */
+  if (exact ? ((long long) x2 - x0) * ((long long) y1 - y0)
+      - ((long long) y2 - y0) * ((long long) x1 - x0) <= 0
+      : ((double) x2 - x0) * ((double) y1 - y0)
+      - ((double) y2 - y0) * ((double) x1 - x0) <= 0.0)
+    return;
+
+  conge_setup_edge (&edges[0], x0, y0, x1, y1);
+  conge_setup_edge (&edges[1], x1, y1, x2, y2);
+  conge_setup_edge (&edges[2], x2, y2, x0, y0);
+
+  /* Solve each row's span once, and fill it in one go. */
+  for (y = top; y <= bottom; y++)
+    {
+      int from = left, to = right;
+
+      conge_clip_to_edge (&edges[0], y, exact, &from, &to);
+      conge_clip_to_edge (&edges[1], y, exact, &from, &to);
+      conge_clip_to_edge (&edges[2], y, exact, &from, &to);
+
+      if (from <= to)
+        {
+          conge_fill_target (target, y, from, to, fill);
+          conge_mark_target (target, y, from, to);
+        }
+    }
+}
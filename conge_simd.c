@@ -0,0 +1,283 @@
+/* Vectorized helpers, chosen at runtime by what the CPU supports. */
+
+#include "conge.h"
+
+#if defined (__x86_64__) || defined (__i386__) \
+  || defined (_M_X64) || defined (_M_IX86)
+#define CONGE__X86 1
+#endif
+
+#ifdef CONGE__X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CONGE__TARGET(isa) /* MSVC emits any intrinsic it's asked for */
+#else
+#include <immintrin.h>
+#define CONGE__TARGET(isa) __attribute__ ((target (isa)))
+#endif
+#endif
+
+/*
+ * Return the index of the lowest set bit. BITS must not be zero.
+ */
+int
+conge_lowest_bit (unsigned int bits)
+{
+#if defined (_MSC_VER)
+  unsigned long index;
+  _BitScanForward (&index, bits);
+  return index;
+#elif defined (__GNUC__)
+  return __builtin_ctz (bits);
+#else
+  int index = 0;
+
+  while (!(bits & 1))
+    {
+      bits >>= 1;
+      index++;
+    }
+
+  return index;
+#endif
+}
+
+int
+conge_find_pixel_scalar (const conge_pixel* a, const conge_pixel* b,
+                         int from, int to, int equal)
+{
+  int x;
+
+  for (x = from; x < to; x++)
+    if ((a[x] == b[x]) == equal)
+      return x;
+
+  return to;
+}
+
+int
+conge_find_wide_pixel (const conge_wide_pixel* a, const conge_wide_pixel* b,
+                       int from, int to, int equal)
+{
+  /* The 16-bit units a wide pixel spans. */
+  int units = sizeof (*a) / sizeof (conge_pixel);
+  int x;
+
+  /*
+   * The first unit which differs is in the first pixel which does, so the
+   * long unchanged runs are skipped with the vectorized search.
+   */
+  if (!equal)
+    return conge_find_pixel ((const conge_pixel*) a, (const conge_pixel*) b,
+                             from * units, to * units, 0) / units;
+
+  /* Runs of changes are short, and equal units don't make equal pixels. */
+  for (x = from; x < to; x++)
+    if (a[x].character == b[x].character && a[x].fg == b[x].fg
+        && a[x].bg == b[x].bg)
+      return x;
+
+  return to;
+}
+
+void
+conge_blit_pixels_scalar (conge_pixel* to, const conge_pixel* from,
+                          int count, conge_pixel key, int reverse)
+{
+  int step = reverse ? -1 : 1, i;
+
+  for (i = 0; i < count; i++, from += step)
+    if (*from != key)
+      to[i] = *from;
+}
+
+#ifdef CONGE__X86
+
+CONGE__TARGET ("sse2") int
+conge_find_pixel_sse2 (const conge_pixel* a, const conge_pixel* b,
+                       int from, int to, int equal)
+{
+  int x;
+
+  /* Compare 8 pixels at once; each equal pixel sets two mask bits. */
+  for (x = from; x + 8 <= to; x += 8)
+    {
+      __m128i va = _mm_loadu_si128 ((const __m128i*) (a + x));
+      __m128i vb = _mm_loadu_si128 ((const __m128i*) (b + x));
+
+      unsigned int mask = _mm_movemask_epi8 (_mm_cmpeq_epi16 (va, vb));
+
+      if (!equal)
+        mask = ~mask & 0xFFFF;
+
+      if (mask != 0)
+        return x + conge_lowest_bit (mask) / 2;
+    }
+
+  return conge_find_pixel_scalar (a, b, x, to, equal);
+}
+
+CONGE__TARGET ("avx2") int
+conge_find_pixel_avx2 (const conge_pixel* a, const conge_pixel* b,
+                       int from, int to, int equal)
+{
+  int x;
+
+  /* Compare 16 pixels at once. */
+  for (x = from; x + 16 <= to; x += 16)
+    {
+      __m256i va = _mm256_loadu_si256 ((const __m256i*) (a + x));
+      __m256i vb = _mm256_loadu_si256 ((const __m256i*) (b + x));
+
+      unsigned int mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi16 (va, vb));
+
+      if (!equal)
+        mask = ~mask;
+
+      if (mask != 0)
+        return x + conge_lowest_bit (mask) / 2;
+    }
+
+  /*
+   * Finish the row here: jumping to SSE2 code with the upper halves of the
+   * registers in use costs more than the whole remainder.
+   */
+  for (; x < to; x++)
+    if ((a[x] == b[x]) == equal)
+      return x;
+
+  return to;
+}
+
+CONGE__TARGET ("sse2") void
+conge_blit_pixels_sse2 (conge_pixel* to, const conge_pixel* from,
+                        int count, conge_pixel key, int reverse)
+{
+  __m128i keys = _mm_set1_epi16 ((short) key);
+  int i;
+
+  /* Blend 8 pixels at once, keeping the ones under the key. */
+  for (i = 0; i + 8 <= count; i += 8)
+    {
+      __m128i pixels, under, mask;
+
+      if (reverse)
+        {
+          pixels = _mm_loadu_si128 ((const __m128i*) (from - i - 7));
+          pixels = _mm_shufflelo_epi16 (pixels, _MM_SHUFFLE (0, 1, 2, 3));
+          pixels = _mm_shufflehi_epi16 (pixels, _MM_SHUFFLE (0, 1, 2, 3));
+          pixels = _mm_shuffle_epi32 (pixels, _MM_SHUFFLE (1, 0, 3, 2));
+        }
+      else
+        pixels = _mm_loadu_si128 ((const __m128i*) (from + i));
+
+      under = _mm_loadu_si128 ((const __m128i*) (to + i));
+      mask = _mm_cmpeq_epi16 (pixels, keys);
+
+      _mm_storeu_si128 ((__m128i*) (to + i),
+                        _mm_or_si128 (_mm_and_si128 (mask, under),
+                                      _mm_andnot_si128 (mask, pixels)));
+    }
+
+  conge_blit_pixels_scalar (to + i, reverse ? from - i : from + i,
+                            count - i, key, reverse);
+}
+
+#endif /* CONGE__X86 */
+
+int
+conge_cpu_has (int isa)
+{
+#ifdef CONGE__X86
+  switch (isa)
+    {
+    case CONGE_SIMD_SSE2:
+#if defined (_M_X64) || defined (__x86_64__)
+      return 1; /* part of x86-64 */
+#elif defined (_MSC_VER)
+      return IsProcessorFeaturePresent (PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#else
+      return __builtin_cpu_supports ("sse2");
+#endif
+    case CONGE_SIMD_AVX2:
+#ifdef _MSC_VER
+      {
+        int info[4];
+
+        /* The OS must save the YMM registers as well. */
+        __cpuid (info, 1);
+
+        if (!(info[2] & (1 << 27)) || (_xgetbv (0) & 6) != 6)
+          return 0;
+
+        __cpuidex (info, 7, 0);
+        return !!(info[1] & (1 << 5));
+      }
+#else
+      return __builtin_cpu_supports ("avx2");
+#endif
+    }
+#endif /* CONGE__X86 */
+
+  return isa == CONGE_SIMD_SCALAR;
+}
+
+conge_find_pixel_func
+conge_get_find_pixel (int isa)
+{
+  if (!conge_cpu_has (isa))
+    return NULL;
+
+  switch (isa)
+    {
+#ifdef CONGE__X86
+    case CONGE_SIMD_SSE2:
+      return conge_find_pixel_sse2;
+    case CONGE_SIMD_AVX2:
+      return conge_find_pixel_avx2;
+#endif
+    case CONGE_SIMD_SCALAR:
+      return conge_find_pixel_scalar;
+    default:
+      return NULL;
+    }
+}
+
+/*
+ * Pick the widest implementation on the first call.
+ */
+int
+conge_find_pixel_auto (const conge_pixel* a, const conge_pixel* b,
+                       int from, int to, int equal)
+{
+  int isa;
+
+  for (isa = CONGE_SIMD_AVX2; isa > CONGE_SIMD_SCALAR; isa--)
+    if (conge_get_find_pixel (isa) != NULL)
+      break;
+
+  conge_find_pixel = conge_get_find_pixel (isa);
+  return conge_find_pixel (a, b, from, to, equal);
+}
+
+conge_find_pixel_func conge_find_pixel = conge_find_pixel_auto;
+
+/*
+ * Pick the blit the same way. Sprite rows are too short for AVX2 to beat
+ * SSE2 by much.
+ */
+void
+conge_blit_pixels_auto (conge_pixel* to, const conge_pixel* from, int count,
+                        conge_pixel key, int reverse)
+{
+#ifdef CONGE__X86
+  if (conge_cpu_has (CONGE_SIMD_SSE2))
+    conge_blit_pixels = conge_blit_pixels_sse2;
+  else
+#endif
+    conge_blit_pixels = conge_blit_pixels_scalar;
+
+  conge_blit_pixels (to, from, count, key, reverse);
+}
+
+conge_blit_pixels_func conge_blit_pixels = conge_blit_pixels_auto;
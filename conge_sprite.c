@@ -0,0 +1,181 @@
+/* Sprites, and maps of tiles drawn from them. */
+
+#include "conge.h"
+
+conge_sprite*
+conge_sprite_new (int w, int h)
+{
+  conge_sprite* sprite;
+  size_t size;
+
+  if (w < 1 || h < 1)
+    return NULL;
+
+  /* The pixels follow the sprite in the same block. */
+  size = (size_t) w * h * sizeof (*sprite->pixels);
+  sprite = malloc (sizeof (*sprite) + size);
+
+  if (sprite == NULL)
+    return NULL;
+
+  sprite->pixels = (conge_pixel*) (sprite + 1);
+  sprite->w = w;
+  sprite->h = h;
+  sprite->key = 0;
+
+  memset (sprite->pixels, 0, size);
+
+  return sprite;
+}
+
+void
+conge_sprite_free (conge_sprite* sprite)
+{
+  free (sprite);
+}
+
+void
+conge_sprite_target (const conge_sprite* sprite, conge_target* target)
+{
+  /* Only ever read from. */
+  target->pixels = sprite->pixels;
+  target->wide = NULL;
+  target->colors = NULL;
+  target->stride = sprite->w;
+
+  target->clip_x0 = 0;
+  target->clip_y0 = 0;
+  target->clip_x1 = sprite->w - 1;
+  target->clip_y1 = sprite->h - 1;
+
+  target->dirty = NULL;
+}
+
+int
+conge_blit (conge_ctx* ctx, const conge_sprite* sprite, int x, int y,
+            int flags)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (sprite == NULL)
+    return 2;
+
+  return conge_blit_area (ctx, sprite, 0, 0, sprite->w, sprite->h, x, y,
+                          flags);
+}
+
+int
+conge_blit_area (conge_ctx* ctx, const conge_sprite* sprite, int sx, int sy,
+                 int w, int h, int x, int y, int flags)
+{
+  conge_target target, source;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (sprite == NULL)
+    return 2;
+
+  if (sx < 0 || sy < 0 || w < 0 || h < 0
+      || w > sprite->w - sx || h > sprite->h - sy)
+    return 3;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  conge_sprite_target (sprite, &source);
+  conge_raster_blit (&target, &source, sprite->key, sx, sy, w, h,
+                     conge_translate (x, dx), conge_translate (y, dy), flags);
+
+  return 0;
+}
+
+void
+conge_raster_tilemap (const conge_target* target, const conge_sprite* atlas,
+                      int tile_w, int tile_h, const int* tiles,
+                      int cols, int rows, int x, int y)
+{
+  int across, count, col0, col1, row0, row1, col, row, line;
+  int left, right;
+
+  across = atlas->w / tile_w;
+  count = across * (atlas->h / tile_h);
+
+  /* Skip the tiles off the screen without looking at them. */
+  col0 = CONGE_MAX (0, conge_floor_div ((long long) target->clip_x0 - x,
+                                        tile_w));
+  col1 = CONGE_MIN (cols - 1, conge_floor_div ((long long) target->clip_x1 - x,
+                                               tile_w));
+  row0 = CONGE_MAX (0, conge_floor_div ((long long) target->clip_y0 - y,
+                                        tile_h));
+  row1 = CONGE_MIN (rows - 1, conge_floor_div ((long long) target->clip_y1 - y,
+                                               tile_h));
+
+  if (col0 > col1)
+    return;
+
+  /* The columns the visible tiles cover, whichever of them are empty. */
+  left = CONGE_MAX (x + col0 * tile_w, target->clip_x0);
+  right = CONGE_MIN (x + (col1 + 1) * tile_w - 1, target->clip_x1);
+
+  for (row = row0; row <= row1; row++)
+    {
+      int top = y + row * tile_h;
+      int first = CONGE_MAX (top, target->clip_y0);
+      int last = CONGE_MIN (top + tile_h - 1, target->clip_y1);
+
+      for (col = col0; col <= col1; col++)
+        {
+          int tile = tiles[(long) cols * row + col];
+          int tx = x + col * tile_w, from, to;
+          const conge_pixel* pixels;
+
+          if (tile < 0 || tile >= count)
+            continue;
+
+          /* Only the tiles at the edges are clipped. */
+          from = CONGE_MAX (tx, left);
+          to = CONGE_MIN (tx + tile_w - 1, right);
+
+          pixels = &atlas->pixels[(long) atlas->w * (tile / across) * tile_h
+                                  + tile % across * tile_w + from - tx];
+
+          for (line = first; line <= last; line++)
+            conge_blit_row (target, (long) target->stride * line + from,
+                            pixels + (long) atlas->w * (line - top),
+                            to - from + 1, atlas->key, 0);
+        }
+
+      /* A row of tiles is marked dirty a line at a time, not a tile. */
+      for (line = first; line <= last; line++)
+        conge_mark_target (target, line, left, right);
+    }
+}
+
+int
+conge_draw_tilemap (conge_ctx* ctx, const conge_sprite* atlas,
+                    int tile_w, int tile_h, const int* tiles,
+                    int cols, int rows, int x, int y)
+{
+  conge_target target;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (atlas == NULL || tiles == NULL)
+    return 2;
+
+  if (tile_w < 1 || tile_h < 1 || tile_w > atlas->w || tile_h > atlas->h)
+    return 3;
+
+  if (conge_view_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  conge_raster_tilemap (&target, atlas, tile_w, tile_h, tiles, cols, rows,
+                        conge_translate (x, dx), conge_translate (y, dy));
+
+  return 0;
+}
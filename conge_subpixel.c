@@ -0,0 +1,363 @@
+/* Subpixels, packed into block and braille characters. */
+
+#include "conge.h"
+
+/* The braille dot of each subpixel of a cell, by row and column. */
+static const unsigned char conge_braille_dots[4][2] =
+  {
+    { 0x01, 0x08 },
+    { 0x02, 0x10 },
+    { 0x04, 0x20 },
+    { 0x40, 0x80 },
+  };
+
+/* U+2800 BRAILLE PATTERN BLANK; the dots are added to it. */
+#define CONGE__BRAILLE 0x2800
+
+/* U+2580 UPPER HALF BLOCK. */
+#define CONGE__UPPER_HALF 0x2580
+
+int
+conge_subpixels_across (int mode)
+{
+  switch (mode)
+    {
+    case CONGE_SUBPIXELS_HALF_BLOCK:
+      return 1;
+    case CONGE_SUBPIXELS_BRAILLE:
+      return 2;
+    default:
+      return 0;
+    }
+}
+
+int
+conge_subpixels_down (int mode)
+{
+  switch (mode)
+    {
+    case CONGE_SUBPIXELS_HALF_BLOCK:
+      return 2;
+    case CONGE_SUBPIXELS_BRAILLE:
+      return 4;
+    default:
+      return 0;
+    }
+}
+
+int
+conge_set_subpixels (conge_ctx* ctx, int mode)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (conge_subpixels_across (mode) == 0 && mode != CONGE_SUBPIXELS_NONE)
+    return 2;
+
+  if (ctx->format != CONGE_FORMAT_WIDE && mode != CONGE_SUBPIXELS_NONE)
+    return 3;
+
+  /* The subframe is made with the next frame. */
+  ctx->subpixels = mode;
+  return 0;
+}
+
+/*
+ * Return VALUE, in cells, in subpixels SCALE to a cell; or the last
+ * subpixel of its cell if LAST is set. Saturated to the range of int.
+ */
+int
+conge_scale_to_subpixels (int value, int scale, int last)
+{
+  long long scaled = (long long) value * scale + (last ? scale - 1 : 0);
+
+  return CONGE_MAX (INT_MIN, CONGE_MIN (scaled, INT_MAX));
+}
+
+int
+conge_subframe_target (conge_ctx* ctx, conge_target* target,
+                       int* dx, int* dy)
+{
+  int across = conge_subpixels_across (ctx->_buffer_subpixels);
+  int down = conge_subpixels_down (ctx->_buffer_subpixels);
+  const conge_viewport* view;
+
+  target->pixels = NULL;
+  target->wide = NULL;
+  target->colors = ctx->subframe;
+  target->stride = ctx->sub_cols;
+
+  target->clip_x0 = 0;
+  target->clip_y0 = 0;
+  target->clip_x1 = ctx->sub_cols - 1;
+  target->clip_y1 = ctx->sub_rows - 1;
+
+  target->dirty = ctx->_sub_dirty;
+
+  *dx = 0;
+  *dy = 0;
+
+  /* A viewport covers all the subpixels of its cells. */
+  if (ctx->_viewport_count > 0)
+    {
+      view = &ctx->_viewports[ctx->_viewport_count - 1];
+
+      *dx = conge_scale_to_subpixels (view->x, across, 0);
+      *dy = conge_scale_to_subpixels (view->y, down, 0);
+
+      target->clip_x0 = CONGE_MAX (target->clip_x0,
+                                   conge_scale_to_subpixels (view->clip_x0,
+                                                             across, 0));
+      target->clip_y0 = CONGE_MAX (target->clip_y0,
+                                   conge_scale_to_subpixels (view->clip_y0,
+                                                             down, 0));
+      target->clip_x1 = CONGE_MIN (target->clip_x1,
+                                   conge_scale_to_subpixels (view->clip_x1,
+                                                             across, 1));
+      target->clip_y1 = CONGE_MIN (target->clip_y1,
+                                   conge_scale_to_subpixels (view->clip_y1,
+                                                             down, 1));
+    }
+
+  return target->clip_x0 > target->clip_x1
+    || target->clip_y0 > target->clip_y1;
+}
+
+void
+conge_prepare_subframe (conge_ctx* ctx)
+{
+  int retain = conge_frame_retained (ctx), y;
+
+  if (ctx->subframe == NULL)
+    return;
+
+  for (y = 0; y < ctx->sub_rows; y++)
+    {
+      unsigned int* row = &ctx->subframe[(long) ctx->sub_cols * y];
+      conge_span* span = &ctx->_sub_dirty[y];
+
+      /* Retained subpixels pile up; start over with a clear subframe. */
+      if (!retain && ctx->_retained)
+        conge_fill_colors (row, ctx->sub_cols, CONGE_CLEAR);
+      else if (!retain && span->min <= span->max)
+        conge_fill_colors (&row[span->min], span->max - span->min + 1,
+                           CONGE_CLEAR);
+
+      span->min = ctx->sub_cols;
+      span->max = -1;
+    }
+}
+
+/*
+ * Pack the cells of row Y from MIN to MAX into half blocks.
+ */
+void
+conge_pack_half_blocks (conge_ctx* ctx, int y, int min, int max)
+{
+  const unsigned int* top = &ctx->subframe[(long) ctx->sub_cols * 2 * y];
+  const unsigned int* bottom = top + ctx->sub_cols;
+  conge_wide_pixel* cells = &ctx->wide_frame[(long) ctx->cols * y];
+  int x;
+
+  for (x = min; x <= max; x++)
+    {
+      unsigned int upper = top[x], lower = bottom[x];
+
+      if (upper == CONGE_CLEAR && lower == CONGE_CLEAR)
+        continue;
+
+      if (upper == CONGE_CLEAR)
+        upper = cells[x].bg;
+      else if (lower == CONGE_CLEAR)
+        lower = cells[x].bg;
+
+      /* A blank is the same on any font, and needs no foreground change. */
+      if (upper == lower)
+        cells[x] = conge_new_wide_pixel (' ', upper, upper);
+      else
+        cells[x] = conge_new_wide_pixel (CONGE__UPPER_HALF, upper, lower);
+    }
+}
+
+/*
+ * Pack the cells of row Y from MIN to MAX into braille characters.
+ */
+void
+conge_pack_braille (conge_ctx* ctx, int y, int min, int max)
+{
+  const unsigned int* rows = &ctx->subframe[(long) ctx->sub_cols * 4 * y];
+  conge_wide_pixel* cells = &ctx->wide_frame[(long) ctx->cols * y];
+  int x, dx, dy;
+
+  for (x = min; x <= max; x++)
+    {
+      unsigned int fg = CONGE_CLEAR;
+      int dots = 0;
+
+      for (dy = 0; dy < 4; dy++)
+        for (dx = 0; dx < 2; dx++)
+          {
+            unsigned int color = rows[ctx->sub_cols * dy + 2 * x + dx];
+
+            if (color == CONGE_CLEAR)
+              continue;
+
+            dots |= conge_braille_dots[dy][dx];
+
+            if (fg == CONGE_CLEAR)
+              fg = color;
+          }
+
+      if (dots == 0)
+        continue;
+
+      cells[x].character = CONGE__BRAILLE + dots;
+      cells[x].fg = fg;
+    }
+}
+
+void
+conge_pack_subpixels (conge_ctx* ctx)
+{
+  int across = conge_subpixels_across (ctx->_buffer_subpixels);
+  int down = conge_subpixels_down (ctx->_buffer_subpixels);
+  int y, i;
+
+  if (ctx->subframe == NULL || ctx->wide_frame == NULL)
+    return;
+
+  /* Only the cells with subpixels drawn this tick change. */
+  for (y = 0; y < ctx->rows; y++)
+    {
+      const conge_span* dirty = &ctx->_sub_dirty[down * y];
+      int min = ctx->sub_cols, max = -1;
+
+      for (i = 0; i < down; i++)
+        {
+          min = CONGE_MIN (min, dirty[i].min);
+          max = CONGE_MAX (max, dirty[i].max);
+        }
+
+      if (min > max)
+        continue;
+
+      min /= across;
+      max /= across;
+
+      if (across == 1)
+        conge_pack_half_blocks (ctx, y, min, max);
+      else
+        conge_pack_braille (ctx, y, min, max);
+
+      conge_mark_dirty (ctx, y, min, max);
+    }
+}
+
+int
+conge_fill_subpixel (conge_ctx* ctx, int x, int y, unsigned int color)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->subframe == NULL)
+    return 2;
+
+  if (conge_subframe_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  cell.color = color;
+  conge_raster_span (&target, y, x, x, &cell);
+
+  return 0;
+}
+
+int
+conge_draw_subpixel_line (conge_ctx* ctx, int x0, int y0, int x1, int y1,
+                          unsigned int color)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->subframe == NULL)
+    return 2;
+
+  if (conge_subframe_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
+
+  cell.color = color;
+  conge_raster_line (&target, x0, y0, x1, y1, &cell);
+
+  return 0;
+}
+
+int
+conge_fill_subpixel_triangle (conge_ctx* ctx, int x0, int y0, int x1, int y1,
+                              int x2, int y2, unsigned int color)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->subframe == NULL)
+    return 2;
+
+  if (conge_subframe_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x0 = conge_translate (x0, dx);
+  y0 = conge_translate (y0, dy);
+  x1 = conge_translate (x1, dx);
+  y1 = conge_translate (y1, dy);
+  x2 = conge_translate (x2, dx);
+  y2 = conge_translate (y2, dy);
+
+  cell.color = color;
+  conge_raster_triangle (&target, x0, y0, x1, y1, x2, y2, &cell);
+
+  return 0;
+}
+
+int
+conge_fill_subpixel_rect (conge_ctx* ctx, int x, int y, int w, int h,
+                          unsigned int color)
+{
+  conge_target target;
+  conge_cell cell;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->subframe == NULL)
+    return 2;
+
+  if (conge_subframe_target (ctx, &target, &dx, &dy))
+    return 0;
+
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  cell.color = color;
+  conge_raster_rect (&target, x, y, w, h, &cell);
+
+  return 0;
+}
@@ -0,0 +1,655 @@
+/* Text: wrapped and aligned, with color markup, or formatted. */
+
+#include "conge.h"
+
+/* What conge_draw_text draws into, and how. */
+typedef struct conge_text conge_text;
+struct conge_text
+{
+  conge_target target;
+  int markup; /* set if ^ sequences are colors */
+  int wrap; /* set if lines are wrapped at WIDTH */
+  int width;
+  int fg, bg; /* the colors of the call */
+  int run_fg, run_bg; /* the colors chosen by markup since */
+};
+
+/*
+ * Return the value of a hex digit, or -1 if C isn't one.
+ */
+int
+conge_hex_digit (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  else if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  else
+    return -1;
+}
+
+/*
+ * Return the bytes of the markup sequence at STRING, or 0 if there's none.
+ */
+int
+conge_markup_length (const char* string)
+{
+  if (string[0] != '^')
+    return 0;
+
+  if (string[1] == 'r' || string[1] == '^')
+    return 2;
+
+  if ((string[1] == 'f' || string[1] == 'b')
+      && conge_hex_digit (string[2]) >= 0)
+    return 3;
+
+  return 0;
+}
+
+/*
+ * Draw the characters from FROM to TO at (X; Y) in the current colors,
+ * and return the column after them.
+ */
+int
+conge_text_run (conge_text* text, const char* from, const char* to, int x,
+                int y)
+{
+  int length = CONGE_MIN (to - from, INT_MAX);
+
+  if (length > 0)
+    conge_raster_string (&text->target, from, length, x, y, text->run_fg,
+                         text->run_bg);
+
+  return conge_translate (x, length);
+}
+
+/*
+ * Draw the line at P onto (X; Y), up to END, or up to the next newline or
+ * the end of the text if END is null, and return where it stopped. The
+ * colors only change between runs of characters, which are drawn at once.
+ */
+const char*
+conge_draw_text_line (conge_text* text, const char* p, const char* end,
+                      int x, int y)
+{
+  const char* run = p;
+  int length;
+
+  while (end != NULL ? p < end : *p != '\0' && *p != '\n')
+    {
+      if (!text->markup || (length = conge_markup_length (p)) == 0)
+        {
+          p++;
+          continue;
+        }
+
+      x = conge_text_run (text, run, p, x, y);
+
+      if (p[1] == 'f')
+        text->run_fg = conge_hex_digit (p[2]);
+      else if (p[1] == 'b')
+        text->run_bg = conge_hex_digit (p[2]);
+      else if (p[1] == 'r')
+        {
+          text->run_fg = text->fg;
+          text->run_bg = text->bg;
+        }
+
+      /* A ^^ leaves its second caret to the next run. */
+      run = p + (p[1] == '^' ? 1 : length);
+      p += length;
+    }
+
+  conge_text_run (text, run, p, x, y);
+  return p;
+}
+
+/*
+ * Find where the line at P ends: at a newline or the end of the text, or
+ * where it's wrapped. Set END to there, and NEXT to where the next line
+ * starts, and return the line's width in columns.
+ */
+int
+conge_measure_line (const conge_text* text, const char* p,
+                    const char** end, const char** next)
+{
+  const char* space = NULL;
+  int columns = 0, space_columns = 0, length;
+
+  for (;;)
+    {
+      if (*p == '\0' || *p == '\n')
+        {
+          *end = p;
+          *next = *p == '\n' ? p + 1 : p;
+          return columns;
+        }
+
+      length = text->markup ? conge_markup_length (p) : 0;
+
+      if (length > 0 && p[1] != '^')
+        {
+          p += length;
+          continue;
+        }
+
+      if (text->wrap && columns == text->width)
+        {
+          /* Break at the last space, or within a word as long as the line. */
+          if (*p == ' ' || space == NULL)
+            {
+              *end = p;
+              *next = *p == ' ' ? p + 1 : p;
+
+              /* A space right before a newline breaks the line for both. */
+              if (*p == ' ' && p[1] == '\n')
+                *next = p + 2;
+
+              return columns;
+            }
+
+          *end = space;
+          *next = space + 1;
+          return space_columns;
+        }
+
+      if (*p == ' ')
+        {
+          space = p;
+          space_columns = columns;
+        }
+
+      columns++;
+      p += length > 0 ? length : 1;
+    }
+}
+
+int
+conge_draw_text (conge_ctx* ctx, const char* string, int x, int y, int w,
+                 int flags, int fg, int bg)
+{
+  int align = flags & (CONGE_ALIGN_CENTER | CONGE_ALIGN_RIGHT);
+  const char *end, *next;
+  conge_text text;
+  int dx, dy;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (string == NULL)
+    return 2;
+
+  if ((align || (flags & CONGE_WRAP)) && w < 1)
+    return 3;
+
+  if (conge_view_target (ctx, &text.target, &dx, &dy))
+    return 0;
+
+  x = conge_translate (x, dx);
+  y = conge_translate (y, dy);
+
+  text.markup = (flags & CONGE_MARKUP) != 0;
+  text.wrap = (flags & CONGE_WRAP) != 0;
+  text.width = w;
+  text.fg = text.run_fg = fg;
+  text.bg = text.run_bg = bg;
+
+  /* Nothing below the clip rectangle is seen, whatever its colors. */
+  for (; y <= text.target.clip_y1; y = conge_translate (y, 1))
+    {
+      if (align || text.wrap)
+        {
+          long long left = x;
+          int columns = conge_measure_line (&text, string, &end, &next);
+
+          if (align == CONGE_ALIGN_CENTER)
+            left += ((long long) w - columns) / 2;
+          else if (align == CONGE_ALIGN_RIGHT)
+            left += (long long) w - columns;
+
+          left = CONGE_MAX (INT_MIN, CONGE_MIN (left, INT_MAX));
+          conge_draw_text_line (&text, string, end, left, y);
+        }
+      else
+        {
+          /* Left-aligned lines are drawn as they're read. */
+          end = conge_draw_text_line (&text, string, NULL, x, y);
+          next = *end == '\n' ? end + 1 : end;
+        }
+
+      if (*end == '\0')
+        break;
+
+      string = next;
+    }
+
+  return 0;
+}
+
+/* A conversion of conge_printf's format, other than its type. */
+typedef struct conge_conversion conge_conversion;
+struct conge_conversion
+{
+  int left; /* the - flag: pad on the right instead */
+  int zero; /* the 0 flag: pad numbers with zeros */
+  char sign; /* the + or space flag: what positive numbers start with */
+  int width; /* the least columns taken, or 0 */
+  int precision; /* or -1 if there's none */
+};
+
+/* Where conge_printf writes, with the colors of the call. */
+typedef struct conge_printer conge_printer;
+struct conge_printer
+{
+  conge_target target;
+  int left; /* where lines start */
+  int x, y; /* where the next character goes */
+  int fg, bg;
+};
+
+/*
+ * Write LENGTH characters of STRING, starting a new line after newlines.
+ */
+void
+conge_print (conge_printer* printer, const char* string, long long length)
+{
+  while (length > 0)
+    {
+      const char* newline = memchr (string, '\n', length);
+      long long run = newline != NULL ? newline - string : length;
+      int count = CONGE_MIN (run, INT_MAX);
+
+      conge_raster_string (&printer->target, string, count, printer->x,
+                           printer->y, printer->fg, printer->bg);
+      printer->x = conge_translate (printer->x, count);
+
+      if (newline == NULL)
+        break;
+
+      printer->x = printer->left;
+      printer->y = conge_translate (printer->y, 1);
+
+      string = newline + 1;
+      length -= run + 1;
+    }
+}
+
+/*
+ * Write COUNT copies of PAD, a space or a zero.
+ */
+void
+conge_print_padding (conge_printer* printer, char pad, int count)
+{
+  static const char spaces[] = "                ";
+  static const char zeros[] = "0000000000000000";
+  int chunk = sizeof (spaces) - 1;
+
+  for (; count > 0; count -= chunk)
+    conge_print (printer, pad == '0' ? zeros : spaces,
+                 CONGE_MIN (count, chunk));
+}
+
+/*
+ * Write a field of CONVERSION: SIGN, if it's not 0, then ZEROS zeros,
+ * LENGTH characters of BODY and TRAILING zeros, padded to its width.
+ * NUMBER is set for the conversions which the 0 flag pads with zeros.
+ */
+void
+conge_print_field (conge_printer* printer,
+                   const conge_conversion* conversion, int number,
+                   char sign, int zeros, const char* body, long long length,
+                   int trailing)
+{
+  long long taken = (sign != 0) + (long long) zeros + length + trailing;
+  int padding = CONGE_MAX (0, conversion->width - taken);
+  int zero_pad = number && conversion->zero && !conversion->left;
+
+  if (!conversion->left && !zero_pad)
+    conge_print_padding (printer, ' ', padding);
+
+  if (sign != 0)
+    conge_print (printer, &sign, 1);
+
+  conge_print_padding (printer, '0', zeros + (zero_pad ? padding : 0));
+  conge_print (printer, body, length);
+  conge_print_padding (printer, '0', trailing);
+
+  if (conversion->left)
+    conge_print_padding (printer, ' ', padding);
+}
+
+/*
+ * Write VALUE in BASE, with DIGITS, and SIGN before it unless it's 0.
+ */
+void
+conge_print_integer (conge_printer* printer,
+                     const conge_conversion* conversion, char sign,
+                     unsigned long long value, int base, const char* digits)
+{
+  char buffer[24];
+  int start = sizeof (buffer), zeros;
+
+  /* The digits come out backwards; a precision of 0 prints 0 as nothing. */
+  while (value != 0 || (start == (int) sizeof (buffer)
+                        && conversion->precision != 0))
+    {
+      buffer[--start] = digits[value % base];
+      value /= base;
+    }
+
+  zeros = CONGE_MAX (0, conversion->precision
+                     - ((int) sizeof (buffer) - start));
+
+  /* The 0 flag is ignored with a precision, as by printf. */
+  if (conversion->precision >= 0)
+    {
+      conge_conversion spaced = *conversion;
+
+      spaced.zero = 0;
+      conge_print_field (printer, &spaced, 1, sign, zeros, buffer + start,
+                         sizeof (buffer) - start, 0);
+    }
+  else
+    conge_print_field (printer, conversion, 1, sign, zeros, buffer + start,
+                       sizeof (buffer) - start, 0);
+}
+
+/*
+ * Write VALUE in fixed point, like printf's %f.
+ */
+void
+conge_print_double (conge_printer* printer,
+                    const conge_conversion* conversion, double value)
+{
+  int precision = conversion->precision < 0 ? 6 : conversion->precision;
+  char sign = conversion->sign, buffer[336];
+  unsigned long long total;
+  double scale = 1.0;
+  int exact = 0, start = sizeof (buffer), i;
+
+  if (value != value)
+    {
+      conge_print_field (printer, conversion, 0, 0, 0, "nan", 3, 0);
+      return;
+    }
+
+  if (value < 0)
+    {
+      sign = '-';
+      value = -value;
+    }
+
+  if (value > 1.7976931348623157e308)
+    {
+      conge_print_field (printer, conversion, 0, sign, 0, "inf", 3, 0);
+      return;
+    }
+
+  /* The digits are exact while they fit in the 53 bits of a double. */
+  while (exact < precision && exact < 22
+         && value * (scale * 10) < 9007199254740992.0)
+    {
+      scale *= 10;
+      exact++;
+    }
+
+  if (value * scale < 9007199254740992.0)
+    {
+      double product = value * scale, error, fraction, rest;
+
+      /* The product is rounded, but with the error it's exact. */
+      error = fma (value, scale, -product);
+      total = (unsigned long long) product;
+      fraction = product - (double) total;
+
+      if (fraction == 0 && error < 0)
+        {
+          total--;
+          fraction = 1;
+        }
+
+      /* Halfway between, the even one is nearest, as with printf. */
+      rest = (fraction - 0.5) + error;
+      total += rest > 0 || (rest == 0 && total % 2 != 0);
+
+      for (i = 0; i < exact; i++, total /= 10)
+        buffer[--start] = '0' + total % 10;
+
+      if (precision > 0)
+        buffer[--start] = '.';
+
+      do
+        {
+          buffer[--start] = '0' + total % 10;
+          total /= 10;
+        }
+      while (total != 0);
+    }
+  else
+    {
+      /* Doubles this large are whole numbers, worked out in base 10^9. */
+      unsigned int limbs[36];
+      int count = 0, exponent, shift;
+
+      total = (unsigned long long) ldexp (frexp (value, &exponent), 53);
+      limbs[count++] = total % 1000000000;
+      limbs[count++] = total / 1000000000;
+
+      for (exponent -= 53; exponent > 0; exponent -= shift)
+        {
+          unsigned long long carry = 0;
+
+          shift = CONGE_MIN (exponent, 29);
+
+          for (i = 0; i < count; i++)
+            {
+              carry += (unsigned long long) limbs[i] << shift;
+              limbs[i] = carry % 1000000000;
+              carry /= 1000000000;
+            }
+
+          if (carry != 0)
+            limbs[count++] = carry;
+        }
+
+      if (precision > 0)
+        buffer[--start] = '.';
+
+      for (i = 0; i < count - 1; i++)
+        for (shift = 0; shift < 9; shift++, limbs[i] /= 10)
+          buffer[--start] = '0' + limbs[i] % 10;
+
+      do
+        {
+          buffer[--start] = '0' + limbs[i] % 10;
+          limbs[i] /= 10;
+        }
+      while (limbs[i] != 0);
+    }
+
+  conge_print_field (printer, conversion, 1, sign, 0, buffer + start,
+                     sizeof (buffer) - start, precision - exact);
+}
+
+int
+conge_vprintf (conge_ctx* ctx, int x, int y, int fg, int bg,
+               const char* format, va_list args)
+{
+  conge_printer printer;
+  conge_conversion conversion;
+  const char *p, *start;
+  int dx, dy, longs;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (format == NULL)
+    return 2;
+
+  if (conge_view_target (ctx, &printer.target, &dx, &dy))
+    return 0;
+
+  printer.left = printer.x = conge_translate (x, dx);
+  printer.y = conge_translate (y, dy);
+  printer.fg = fg;
+  printer.bg = bg;
+
+  for (p = format; *p != '\0'; p++)
+    {
+      long long signed_value = 0;
+      unsigned long long value;
+      const char* string;
+      char character;
+
+      /* The text between conversions is written in runs. */
+      for (start = p; *p != '\0' && *p != '%'; p++)
+        ;
+
+      conge_print (&printer, start, p - start);
+
+      if (*p == '\0')
+        break;
+
+      start = p++;
+
+      conversion.left = 0;
+      conversion.zero = 0;
+      conversion.sign = 0;
+      conversion.width = 0;
+      conversion.precision = -1;
+
+      for (;; p++)
+        if (*p == '-')
+          conversion.left = 1;
+        else if (*p == '0')
+          conversion.zero = 1;
+        else if (*p == '+')
+          conversion.sign = '+';
+        else if (*p == ' ' && conversion.sign == 0)
+          conversion.sign = ' ';
+        else if (*p != ' ')
+          break;
+
+      if (*p == '*')
+        {
+          conversion.width = va_arg (args, int);
+          p++;
+
+          /* A negative width stands for the - flag. */
+          if (conversion.width < 0)
+            {
+              conversion.left = 1;
+              conversion.width = conversion.width == INT_MIN ? INT_MAX
+                : -conversion.width;
+            }
+        }
+      else
+        for (; *p >= '0' && *p <= '9'; p++)
+          conversion.width = CONGE_MIN (10LL * conversion.width + *p - '0',
+                                        INT_MAX);
+
+      if (*p == '.')
+        {
+          conversion.precision = 0;
+          p++;
+
+          if (*p == '*')
+            {
+              /* A negative precision is as good as none. */
+              conversion.precision = va_arg (args, int);
+              conversion.precision = CONGE_MAX (-1, conversion.precision);
+              p++;
+            }
+          else
+            for (; *p >= '0' && *p <= '9'; p++)
+              conversion.precision = CONGE_MIN (10LL * conversion.precision
+                                                + *p - '0', INT_MAX);
+        }
+
+      /* Shorts are passed as ints anyway. */
+      for (longs = 0; *p == 'l' || *p == 'h'; p++)
+        longs += *p == 'l';
+
+      switch (*p)
+        {
+        case 'd':
+        case 'i':
+          if (longs >= 2)
+            signed_value = va_arg (args, long long);
+          else if (longs == 1)
+            signed_value = va_arg (args, long);
+          else
+            signed_value = va_arg (args, int);
+
+          value = signed_value < 0 ? -(unsigned long long) signed_value
+            : (unsigned long long) signed_value;
+          conge_print_integer (&printer, &conversion,
+                               signed_value < 0 ? '-' : conversion.sign,
+                               value, 10, "0123456789");
+          break;
+        case 'u':
+        case 'x':
+        case 'X':
+          if (longs >= 2)
+            value = va_arg (args, unsigned long long);
+          else if (longs == 1)
+            value = va_arg (args, unsigned long);
+          else
+            value = va_arg (args, unsigned int);
+
+          conge_print_integer (&printer, &conversion, 0, value,
+                               *p == 'u' ? 10 : 16,
+                               *p == 'X' ? "0123456789ABCDEF"
+                               : "0123456789abcdef");
+          break;
+        case 'f':
+        case 'F':
+          conge_print_double (&printer, &conversion, va_arg (args, double));
+          break;
+        case 'c':
+          character = (char) va_arg (args, int);
+          conge_print_field (&printer, &conversion, 0, 0, 0, &character, 1,
+                             0);
+          break;
+        case 's':
+          string = va_arg (args, const char*);
+
+          if (string == NULL)
+            string = "(null)";
+
+          conge_print_field (&printer, &conversion, 0, 0, 0, string,
+                             conge_string_length (string,
+                                                  conversion.precision < 0
+                                                  ? INT_MAX
+                                                  : conversion.precision),
+                             0);
+          break;
+        case '%':
+          conge_print (&printer, "%", 1);
+          break;
+        default:
+          /* Its argument can't be skipped, so nothing after it is right. */
+          conge_print (&printer, start, p - start + (*p != '\0'));
+          return 3;
+        }
+    }
+
+  return 0;
+}
+
+int
+conge_printf (conge_ctx* ctx, int x, int y, int fg, int bg,
+              const char* format, ...)
+{
+  va_list args;
+  int code;
+
+  va_start (args, format);
+  code = conge_vprintf (ctx, x, y, fg, bg, format, args);
+  va_end (args);
+
+  return code;
+}
@@ -0,0 +1,463 @@
+/* Threads, and a pool of workers to share jobs with. */
+
+#include "conge.h"
+
+#ifdef _WIN32
+
+/* Windows threads start with a different signature. */
+typedef struct conge_thread_start_data conge_thread_start_data;
+struct conge_thread_start_data
+{
+  conge_thread_func func;
+  void* data;
+};
+
+DWORD WINAPI
+conge_thread_main (LPVOID parameter)
+{
+  conge_thread_start_data start = *(conge_thread_start_data*) parameter;
+
+  free (parameter);
+  start.func (start.data);
+
+  return 0;
+}
+
+int
+conge_thread_start (conge_thread* thread, conge_thread_func func, void* data)
+{
+  conge_thread_start_data* start = malloc (sizeof (*start));
+
+  if (start == NULL)
+    return 1;
+
+  start->func = func;
+  start->data = data;
+
+  *thread = CreateThread (NULL, 0, conge_thread_main, start, 0, NULL);
+
+  if (*thread == NULL)
+    {
+      free (start);
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+conge_thread_join (conge_thread* thread)
+{
+  WaitForSingleObject (*thread, INFINITE);
+  CloseHandle (*thread);
+}
+
+int
+conge_mutex_init (conge_mutex* mutex)
+{
+  InitializeCriticalSection (mutex);
+  return 0;
+}
+
+void
+conge_mutex_destroy (conge_mutex* mutex)
+{
+  DeleteCriticalSection (mutex);
+}
+
+void
+conge_mutex_lock (conge_mutex* mutex)
+{
+  EnterCriticalSection (mutex);
+}
+
+void
+conge_mutex_unlock (conge_mutex* mutex)
+{
+  LeaveCriticalSection (mutex);
+}
+
+int
+conge_cond_init (conge_cond* cond)
+{
+  InitializeConditionVariable (cond);
+  return 0;
+}
+
+void
+conge_cond_destroy (conge_cond* cond)
+{
+  /* Windows condition variables need no cleanup. */
+}
+
+void
+conge_cond_wait (conge_cond* cond, conge_mutex* mutex)
+{
+  SleepConditionVariableCS (cond, mutex, INFINITE);
+}
+
+void
+conge_cond_broadcast (conge_cond* cond)
+{
+  WakeAllConditionVariable (cond);
+}
+
+int
+conge_cond_timed_wait (conge_cond* cond, conge_mutex* mutex, double seconds)
+{
+  DWORD timeout = (DWORD) ceil (1000 * CONGE_MIN (seconds, 1e6));
+
+  return !SleepConditionVariableCS (cond, mutex, timeout);
+}
+
+long
+conge_atomic_add (volatile long* value, long amount)
+{
+  return InterlockedExchangeAdd (value, amount) + amount;
+}
+
+long
+conge_atomic_load (volatile long* value)
+{
+  return InterlockedCompareExchange (value, 0, 0);
+}
+
+void
+conge_atomic_store (volatile long* value, long new_value)
+{
+  InterlockedExchange (value, new_value);
+}
+
+int
+conge_cpu_count (void)
+{
+  SYSTEM_INFO info;
+
+  GetSystemInfo (&info);
+  return CONGE_MAX (1, (int) info.dwNumberOfProcessors);
+}
+
+#else
+
+/* POSIX threads return a pointer. */
+typedef struct conge_thread_start_data conge_thread_start_data;
+struct conge_thread_start_data
+{
+  conge_thread_func func;
+  void* data;
+};
+
+void*
+conge_thread_main (void* parameter)
+{
+  conge_thread_start_data start = *(conge_thread_start_data*) parameter;
+
+  free (parameter);
+  start.func (start.data);
+
+  return NULL;
+}
+
+int
+conge_thread_start (conge_thread* thread, conge_thread_func func, void* data)
+{
+  conge_thread_start_data* start = malloc (sizeof (*start));
+
+  if (start == NULL)
+    return 1;
+
+  start->func = func;
+  start->data = data;
+
+  if (pthread_create (thread, NULL, conge_thread_main, start) != 0)
+    {
+      free (start);
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+conge_thread_join (conge_thread* thread)
+{
+  pthread_join (*thread, NULL);
+}
+
+int
+conge_mutex_init (conge_mutex* mutex)
+{
+  return pthread_mutex_init (mutex, NULL);
+}
+
+void
+conge_mutex_destroy (conge_mutex* mutex)
+{
+  pthread_mutex_destroy (mutex);
+}
+
+void
+conge_mutex_lock (conge_mutex* mutex)
+{
+  pthread_mutex_lock (mutex);
+}
+
+void
+conge_mutex_unlock (conge_mutex* mutex)
+{
+  pthread_mutex_unlock (mutex);
+}
+
+int
+conge_cond_init (conge_cond* cond)
+{
+  return pthread_cond_init (cond, NULL);
+}
+
+void
+conge_cond_destroy (conge_cond* cond)
+{
+  pthread_cond_destroy (cond);
+}
+
+void
+conge_cond_wait (conge_cond* cond, conge_mutex* mutex)
+{
+  pthread_cond_wait (cond, mutex);
+}
+
+void
+conge_cond_broadcast (conge_cond* cond)
+{
+  pthread_cond_broadcast (cond);
+}
+
+int
+conge_cond_timed_wait (conge_cond* cond, conge_mutex* mutex, double seconds)
+{
+  struct timespec deadline;
+
+  /* Condition variables time out by the wall clock. */
+  clock_gettime (CLOCK_REALTIME, &deadline);
+
+  seconds = CONGE_MIN (seconds, 1e6);
+  deadline.tv_sec += (time_t) seconds;
+  deadline.tv_nsec += (long) ((seconds - (time_t) seconds) * 1e9);
+
+  if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+  return pthread_cond_timedwait (cond, mutex, &deadline) != 0;
+}
+
+long
+conge_atomic_add (volatile long* value, long amount)
+{
+  return __sync_add_and_fetch (value, amount);
+}
+
+long
+conge_atomic_load (volatile long* value)
+{
+  return __atomic_load_n (value, __ATOMIC_ACQUIRE);
+}
+
+void
+conge_atomic_store (volatile long* value, long new_value)
+{
+  __atomic_store_n (value, new_value, __ATOMIC_RELEASE);
+}
+
+int
+conge_cpu_count (void)
+{
+  long count = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return count > 0 ? (int) count : 1;
+}
+
+#endif /* _WIN32 */
+
+struct conge_pool
+{
+  int count; /* the workers, not counting the calling thread */
+  conge_thread* threads;
+  conge_mutex mutex; /* guards everything but NEXT */
+  conge_cond start, finish;
+  unsigned int generation; /* changes whenever a job starts */
+  int running; /* the workers which haven't finished the job yet */
+  int quit;
+  conge_job job;
+  void* data;
+  int jobs;
+  volatile long next; /* the next index to take */
+};
+
+/*
+ * Take indices until there are none left.
+ */
+void
+conge_pool_work (conge_pool* pool)
+{
+  long index;
+
+  while ((index = conge_atomic_add (&pool->next, 1) - 1) < pool->jobs)
+    pool->job (pool->data, index);
+}
+
+void
+conge_pool_worker (void* data)
+{
+  conge_pool* pool = data;
+  unsigned int generation = 0;
+
+  for (;;)
+    {
+      conge_mutex_lock (&pool->mutex);
+
+      while (pool->generation == generation && !pool->quit)
+        conge_cond_wait (&pool->start, &pool->mutex);
+
+      if (pool->quit)
+        {
+          conge_mutex_unlock (&pool->mutex);
+          return;
+        }
+
+      generation = pool->generation;
+      conge_mutex_unlock (&pool->mutex);
+
+      conge_pool_work (pool);
+
+      conge_mutex_lock (&pool->mutex);
+
+      if (--pool->running == 0)
+        conge_cond_broadcast (&pool->finish);
+
+      conge_mutex_unlock (&pool->mutex);
+    }
+}
+
+/*
+ * Stop the first COUNT workers and free the pool.
+ */
+void
+conge_pool_stop (conge_pool* pool, int count)
+{
+  int i;
+
+  conge_mutex_lock (&pool->mutex);
+  pool->quit = 1;
+  conge_cond_broadcast (&pool->start);
+  conge_mutex_unlock (&pool->mutex);
+
+  for (i = 0; i < count; i++)
+    conge_thread_join (&pool->threads[i]);
+
+  conge_cond_destroy (&pool->finish);
+  conge_cond_destroy (&pool->start);
+  conge_mutex_destroy (&pool->mutex);
+
+  free (pool->threads);
+  free (pool);
+}
+
+conge_pool*
+conge_pool_new (int threads)
+{
+  conge_pool* pool;
+  int i;
+
+  if (threads < 2)
+    return NULL;
+
+  pool = malloc (sizeof (*pool));
+
+  if (pool == NULL)
+    return NULL;
+
+  pool->count = threads - 1;
+  pool->threads = malloc (pool->count * sizeof (*pool->threads));
+
+  if (pool->threads == NULL)
+    {
+      free (pool);
+      return NULL;
+    }
+
+  if (conge_mutex_init (&pool->mutex))
+    {
+      free (pool->threads);
+      free (pool);
+      return NULL;
+    }
+
+  if (conge_cond_init (&pool->start))
+    {
+      conge_mutex_destroy (&pool->mutex);
+      free (pool->threads);
+      free (pool);
+      return NULL;
+    }
+
+  if (conge_cond_init (&pool->finish))
+    {
+      conge_cond_destroy (&pool->start);
+      conge_mutex_destroy (&pool->mutex);
+      free (pool->threads);
+      free (pool);
+      return NULL;
+    }
+
+  pool->generation = 0;
+  pool->running = 0;
+  pool->quit = 0;
+  pool->jobs = 0;
+  pool->next = 0;
+
+  for (i = 0; i < pool->count; i++)
+    if (conge_thread_start (&pool->threads[i], conge_pool_worker, pool))
+      {
+        conge_pool_stop (pool, i);
+        return NULL;
+      }
+
+  return pool;
+}
+
+void
+conge_pool_free (conge_pool* pool)
+{
+  if (pool != NULL)
+    conge_pool_stop (pool, pool->count);
+}
+
+void
+conge_pool_run (conge_pool* pool, conge_job job, void* data, int count)
+{
+  conge_mutex_lock (&pool->mutex);
+
+  pool->job = job;
+  pool->data = data;
+  pool->jobs = count;
+  pool->next = 0;
+
+  pool->running = pool->count;
+  pool->generation++;
+
+  conge_cond_broadcast (&pool->start);
+  conge_mutex_unlock (&pool->mutex);
+
+  /* Don't just wait: help out. */
+  conge_pool_work (pool);
+
+  conge_mutex_lock (&pool->mutex);
+
+  while (pool->running > 0)
+    conge_cond_wait (&pool->finish, &pool->mutex);
+
+  conge_mutex_unlock (&pool->mutex);
+}
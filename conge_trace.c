@@ -0,0 +1,280 @@
+/* Frame tracing: where each frame's time goes, and what it sent. */
+
+#include "conge.h"
+
+const char* const conge_phase_names[CONGE_PHASE_COUNT] =
+  {
+    "window_size",
+    "prepare",
+    "input",
+    "tick",
+    "title",
+    "diff",
+    "flush",
+    "sleep",
+  };
+
+void
+conge_trace_begin (conge_ctx* ctx, int phase)
+{
+  /* The console's clock is real even for headless contexts. */
+  if (ctx->_trace != NULL)
+    ctx->_stats.phase_start[phase] = conge_console_time (ctx);
+}
+
+void
+conge_trace_end (conge_ctx* ctx, int phase)
+{
+  if (ctx->_trace != NULL)
+    ctx->_stats.phase_time[phase] = conge_console_time (ctx)
+      - ctx->_stats.phase_start[phase];
+}
+
+void
+conge_trace_present_begin (conge_ctx* ctx, int phase)
+{
+  conge_swap* swap = ctx->_presenting;
+
+  if (swap->traced)
+    swap->stats.phase_start[phase] = conge_console_time (ctx);
+  else
+    swap->stats.phase_time[phase] = 0.0;
+}
+
+void
+conge_trace_present_end (conge_ctx* ctx, int phase)
+{
+  conge_swap* swap = ctx->_presenting;
+
+  if (swap->traced)
+    swap->stats.phase_time[phase] = conge_console_time (ctx)
+      - swap->stats.phase_start[phase];
+}
+
+void
+conge_trace_presented (conge_ctx* ctx, const conge_swap* swap, int pipelined)
+{
+  conge_frame_stats* stats = &ctx->_stats;
+  int phases[] = { CONGE_PHASE_TITLE, CONGE_PHASE_DIFF, CONGE_PHASE_FLUSH };
+  int i;
+
+  if (ctx->_trace == NULL)
+    return;
+
+  for (i = 0; i < 3; i++)
+    {
+      stats->phase_start[phases[i]] = swap->stats.phase_start[phases[i]];
+      stats->phase_time[phases[i]] = swap->stats.phase_time[phases[i]];
+    }
+
+  stats->cells_diffed = swap->stats.cells_diffed;
+  stats->cells_emitted = swap->stats.cells_emitted;
+  stats->cursor_moves = swap->stats.cursor_moves;
+  stats->color_changes = swap->stats.color_changes;
+  stats->pipelined = pipelined;
+}
+
+void
+conge_trace_frame (conge_ctx* ctx)
+{
+  conge_frame_stats* stats = &ctx->_stats;
+  int i;
+
+  if (ctx->_trace != NULL && ctx->_stats_started)
+    {
+      stats->bytes = ctx->frame_bytes;
+      stats->writes = ctx->frame_writes;
+
+      ctx->_trace[ctx->_trace_next] = *stats;
+      ctx->_trace_next = (ctx->_trace_next + 1) % ctx->_trace_capacity;
+
+      if (ctx->_trace_count < ctx->_trace_capacity)
+        ctx->_trace_count++;
+    }
+
+  stats->frame = ctx->ticks;
+  stats->start = ctx->_trace != NULL ? conge_console_time (ctx) : 0.0;
+
+  for (i = 0; i < CONGE_PHASE_COUNT; i++)
+    {
+      stats->phase_start[i] = stats->start;
+      stats->phase_time[i] = 0.0;
+    }
+
+  stats->cells_diffed = 0;
+  stats->cells_emitted = 0;
+  stats->cursor_moves = 0;
+  stats->color_changes = 0;
+  stats->pipelined = 0;
+
+  ctx->_stats_started = 1;
+}
+
+int
+conge_trace_start (conge_ctx* ctx, int frames)
+{
+#ifndef CONGE_NO_TRACE
+  conge_frame_stats* trace;
+#endif
+
+  if (ctx == NULL)
+    return 1;
+
+  if (frames < 1)
+    return 2;
+
+#ifdef CONGE_NO_TRACE
+  return 4;
+#else
+  trace = malloc (frames * sizeof (*trace));
+
+  if (trace == NULL)
+    return 3;
+
+  free (ctx->_trace);
+
+  ctx->_trace = trace;
+  ctx->_trace_capacity = frames;
+  ctx->_trace_count = 0;
+  ctx->_trace_next = 0;
+
+  /* The current frame wasn't timed from its start. */
+  ctx->_stats_started = 0;
+
+  return 0;
+#endif
+}
+
+void
+conge_trace_stop (conge_ctx* ctx)
+{
+  if (ctx != NULL)
+    {
+      free (ctx->_trace);
+
+      ctx->_trace = NULL;
+      ctx->_trace_capacity = 0;
+      ctx->_trace_count = 0;
+      ctx->_trace_next = 0;
+    }
+}
+
+int
+conge_trace_count (conge_ctx* ctx)
+{
+  return ctx != NULL ? ctx->_trace_count : 0;
+}
+
+const conge_frame_stats*
+conge_trace_get (conge_ctx* ctx, int index)
+{
+  if (ctx == NULL || index < 0 || index >= ctx->_trace_count)
+    return NULL;
+
+  index += ctx->_trace_next - ctx->_trace_count + ctx->_trace_capacity;
+  return &ctx->_trace[index % ctx->_trace_capacity];
+}
+
+/*
+ * Write the frames as complete events, one per phase, with the presenter's
+ * counters alongside. The presenter thread's phases get a track of their
+ * own.
+ */
+void
+conge_trace_dump_chrome (conge_ctx* ctx, FILE* file)
+{
+  double origin = ctx->_trace_count > 0
+    ? conge_trace_get (ctx, 0)->start : 0.0;
+  const char* separator = "\n";
+  int i, phase;
+
+  fprintf (file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+  for (i = 0; i < ctx->_trace_count; i++)
+    {
+      const conge_frame_stats* stats = conge_trace_get (ctx, i);
+
+      for (phase = 0; phase < CONGE_PHASE_COUNT; phase++)
+        {
+          int presenter = stats->pipelined
+            && phase >= CONGE_PHASE_TITLE && phase <= CONGE_PHASE_FLUSH;
+
+          if (stats->phase_time[phase] <= 0.0)
+            continue;
+
+          fprintf (file, "%s{\"name\": \"%s\", \"cat\": \"conge\", "
+                   "\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                   "\"pid\": 1, \"tid\": %d, \"args\": {\"frame\": %u}}",
+                   separator, conge_phase_names[phase],
+                   1e6 * (stats->phase_start[phase] - origin),
+                   1e6 * stats->phase_time[phase], presenter ? 2 : 1,
+                   stats->frame);
+
+          separator = ",\n";
+        }
+
+      fprintf (file, "%s{\"name\": \"output\", \"ph\": \"C\", "
+               "\"ts\": %.3f, \"pid\": 1, \"args\": {"
+               "\"cells_diffed\": %u, \"cells_emitted\": %u, "
+               "\"cursor_moves\": %u, \"color_changes\": %u, "
+               "\"bytes\": %u, \"writes\": %u}}",
+               separator, 1e6 * (stats->start - origin),
+               stats->cells_diffed, stats->cells_emitted,
+               stats->cursor_moves, stats->color_changes,
+               stats->bytes, stats->writes);
+
+      separator = ",\n";
+    }
+
+  fprintf (file, "\n]}\n");
+}
+
+void
+conge_trace_dump_csv (conge_ctx* ctx, FILE* file)
+{
+  int i, phase;
+
+  fprintf (file, "frame");
+
+  for (phase = 0; phase < CONGE_PHASE_COUNT; phase++)
+    fprintf (file, ",%s_us", conge_phase_names[phase]);
+
+  fprintf (file, ",cells_diffed,cells_emitted,cursor_moves,color_changes"
+           ",bytes,writes\n");
+
+  for (i = 0; i < ctx->_trace_count; i++)
+    {
+      const conge_frame_stats* stats = conge_trace_get (ctx, i);
+
+      fprintf (file, "%u", stats->frame);
+
+      for (phase = 0; phase < CONGE_PHASE_COUNT; phase++)
+        fprintf (file, ",%.3f", 1e6 * stats->phase_time[phase]);
+
+      fprintf (file, ",%u,%u,%u,%u,%u,%u\n", stats->cells_diffed,
+               stats->cells_emitted, stats->cursor_moves,
+               stats->color_changes, stats->bytes, stats->writes);
+    }
+}
+
+int
+conge_trace_dump (conge_ctx* ctx, FILE* file, int format)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (file == NULL)
+    return 2;
+
+  switch (format)
+    {
+    case CONGE_TRACE_CHROME:
+      conge_trace_dump_chrome (ctx, file);
+      return 0;
+    case CONGE_TRACE_CSV:
+      conge_trace_dump_csv (ctx, file);
+      return 0;
+    default:
+      return 3;
+    }
+}
@@ -0,0 +1,130 @@
+/* Viewports: clip rectangles and origins for the drawing functions. */
+
+#include "conge.h"
+
+int
+conge_translate (int value, int by)
+{
+  long long sum = (long long) value + by;
+
+  /* Geometry this far out is off the screen either way. */
+  return CONGE_MAX (INT_MIN, CONGE_MIN (sum, INT_MAX));
+}
+
+/*
+ * Push a viewport whose clip rectangle is the W by H one at (X; Y) of the
+ * current viewport, within its clip rectangle. Its origin moves there if
+ * MOVE is set.
+ */
+int
+conge_push_view (conge_ctx* ctx, int x, int y, int w, int h, int move)
+{
+  conge_viewport view, *top;
+  long long x0, y0;
+
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->_viewport_count == CONGE_MAX_VIEWPORTS)
+    return 2;
+
+  if (ctx->_viewport_count > 0)
+    view = ctx->_viewports[ctx->_viewport_count - 1];
+  else
+    {
+      /* The screen itself is clipped to when drawing. */
+      view.x = 0;
+      view.y = 0;
+      view.clip_x0 = INT_MIN;
+      view.clip_y0 = INT_MIN;
+      view.clip_x1 = INT_MAX;
+      view.clip_y1 = INT_MAX;
+    }
+
+  top = &ctx->_viewports[ctx->_viewport_count++];
+
+  x0 = (long long) view.x + x;
+  y0 = (long long) view.y + y;
+
+  top->x = move ? conge_translate (view.x, x) : view.x;
+  top->y = move ? conge_translate (view.y, y) : view.y;
+
+  /* An empty rectangle has its corners crossed, and clips everything. */
+  top->clip_x0 = CONGE_MAX (view.clip_x0, CONGE_MIN (x0, INT_MAX));
+  top->clip_y0 = CONGE_MAX (view.clip_y0, CONGE_MIN (y0, INT_MAX));
+  top->clip_x1 = CONGE_MIN (view.clip_x1, CONGE_MAX (x0 + w - 1, INT_MIN));
+  top->clip_y1 = CONGE_MIN (view.clip_y1, CONGE_MAX (y0 + h - 1, INT_MIN));
+
+  return 0;
+}
+
+int
+conge_push_viewport (conge_ctx* ctx, int x, int y, int w, int h)
+{
+  return conge_push_view (ctx, x, y, w, h, 1);
+}
+
+int
+conge_push_clip (conge_ctx* ctx, int x, int y, int w, int h)
+{
+  return conge_push_view (ctx, x, y, w, h, 0);
+}
+
+int
+conge_pop_viewport (conge_ctx* ctx)
+{
+  if (ctx == NULL)
+    return 1;
+
+  if (ctx->_viewport_count == 0)
+    return 2;
+
+  ctx->_viewport_count--;
+  return 0;
+}
+
+int
+conge_view_target (conge_ctx* ctx, conge_target* target, int* dx, int* dy)
+{
+  const conge_viewport* view;
+
+  conge_frame_target (ctx, target);
+
+  *dx = 0;
+  *dy = 0;
+
+  if (ctx->_viewport_count > 0)
+    {
+      view = &ctx->_viewports[ctx->_viewport_count - 1];
+
+      *dx = view->x;
+      *dy = view->y;
+
+      target->clip_x0 = CONGE_MAX (target->clip_x0, view->clip_x0);
+      target->clip_y0 = CONGE_MAX (target->clip_y0, view->clip_y0);
+      target->clip_x1 = CONGE_MIN (target->clip_x1, view->clip_x1);
+      target->clip_y1 = CONGE_MIN (target->clip_y1, view->clip_y1);
+    }
+
+  /* Nothing can be drawn before the first tick. */
+  return target->clip_x0 > target->clip_x1
+    || target->clip_y0 > target->clip_y1
+    || (target->pixels == NULL && target->wide == NULL);
+}
+
+int
+conge_view_point (conge_ctx* ctx, int* x, int* y)
+{
+  const conge_viewport* view;
+
+  if (ctx->_viewport_count == 0)
+    return 0;
+
+  view = &ctx->_viewports[ctx->_viewport_count - 1];
+
+  *x = conge_translate (*x, view->x);
+  *y = conge_translate (*y, view->y);
+
+  return *x < view->clip_x0 || *x > view->clip_x1
+    || *y < view->clip_y0 || *y > view->clip_y1;
+}
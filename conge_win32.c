@@ -0,0 +1,266 @@
+/* The Windows console backend. */
+
+#include "conge.h"
+
+#ifdef _WIN32
+
+/* timeBeginPeriod lives in winmm. */
+#ifdef _MSC_VER
+#pragma comment (lib, "winmm.lib")
+#endif
+
+/* Sleep may overshoot by a millisecond even at its finest; spin the rest. */
+#define CONGE__SPIN_TIME 0.002
+
+void
+conge_init_console (conge_ctx* ctx)
+{
+  ctx->_input = GetStdHandle (STD_INPUT_HANDLE);
+  ctx->_output = GetStdHandle (STD_OUTPUT_HANDLE);
+  ctx->_window = GetConsoleWindow ();
+  ctx->_record_buttons = 0;
+  ctx->_code_page = 0;
+  ctx->_modes_saved = 0;
+}
+
+void
+conge_open_console (conge_ctx* ctx)
+{
+  /* Mouse support, and resize events to wake up idle contexts. */
+  DWORD mouse_flags = ENABLE_MOUSE_INPUT | ENABLE_WINDOW_INPUT
+    | ENABLE_EXTENDED_FLAGS;
+
+  /* The console keeps its modes after exit, so they're put back then. */
+  ctx->_modes_saved = GetConsoleMode (ctx->_input, &ctx->_input_mode)
+    && GetConsoleMode (ctx->_output, &ctx->_output_mode);
+
+  SetConsoleMode (ctx->_input, mouse_flags);
+
+  /* The frames are drawn with VT escape sequences. */
+  DWORD output_flags = ENABLE_PROCESSED_OUTPUT
+    | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+  SetConsoleMode (ctx->_output, output_flags);
+
+  /* Wide pixels are sent as UTF-8. */
+  if (ctx->format == CONGE_FORMAT_WIDE)
+    {
+      ctx->_code_page = GetConsoleOutputCP ();
+      SetConsoleOutputCP (CP_UTF8);
+    }
+
+  /* Sleep in milliseconds rather than in 15.6 ms scheduler ticks. */
+  timeBeginPeriod (1);
+}
+
+void
+conge_close_console (conge_ctx* ctx)
+{
+  conge_reset_output (ctx);
+  timeEndPeriod (1);
+
+  if (ctx->_code_page != 0)
+    {
+      SetConsoleOutputCP (ctx->_code_page);
+      ctx->_code_page = 0;
+    }
+
+  if (ctx->_modes_saved)
+    {
+      SetConsoleMode (ctx->_input, ctx->_input_mode);
+      SetConsoleMode (ctx->_output, ctx->_output_mode);
+      ctx->_modes_saved = 0;
+    }
+}
+
+/*
+ * Update the window size variables.
+ */
+void
+conge_get_window_size (conge_ctx* ctx)
+{
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  GetConsoleScreenBufferInfo (ctx->_output, &csbi);
+
+  ctx->cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+  ctx->rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+}
+
+int
+conge_write_console (conge_ctx* ctx, const char* data, int length)
+{
+  return write (1, data, length);
+}
+
+double
+conge_console_time (conge_ctx* ctx)
+{
+  LARGE_INTEGER counter, frequency;
+
+  QueryPerformanceCounter (&counter);
+  QueryPerformanceFrequency (&frequency);
+
+  return (double) counter.QuadPart / frequency.QuadPart;
+}
+
+void
+conge_console_sleep (conge_ctx* ctx, double seconds)
+{
+  double deadline = conge_console_time (ctx) + seconds;
+
+  if (seconds > CONGE__SPIN_TIME)
+    Sleep ((DWORD) (1000 * (seconds - CONGE__SPIN_TIME)));
+
+  /* Give up the rest of the time slice while spinning. */
+  while (conge_console_time (ctx) < deadline)
+    Sleep (0);
+}
+
+void
+conge_console_wait (conge_ctx* ctx, double seconds)
+{
+  DWORD timeout = INFINITE;
+
+  if (seconds > 0.0)
+    timeout = (DWORD) ceil (1000 * CONGE_MIN (seconds, 1e6));
+
+  /* The input handle is signaled while it has events to read. */
+  WaitForSingleObject (ctx->_input, timeout);
+}
+
+/*
+ * Update mouse cursor positions (in pixels), and handle mouse grab.
+ */
+void
+conge_process_mouse (conge_ctx* ctx)
+{
+  if (ctx->grab)
+    {
+      POINT mouse_p;
+      RECT window;
+
+      GetCursorPos (&mouse_p);
+      GetWindowRect (ctx->_window, &window);
+
+      /* Find the center of the console window. */
+      int cx = window.left + (window.right - window.left) / 2;
+      int cy = window.top  + (window.bottom - window.top) / 2;
+
+      ctx->mouse_dx = mouse_p.x - cx;
+      ctx->mouse_dy = mouse_p.y - cy;
+
+      SetCursorPos (cx, cy);
+    }
+  else
+    {
+      ctx->mouse_dx = 0;
+      ctx->mouse_dy = 0;
+    }
+}
+
+/*
+ * Turn a console mouse record into events.
+ */
+void
+conge_read_mouse_record (conge_ctx* ctx, const MOUSE_EVENT_RECORD* record)
+{
+  static const int buttons[] = { CONGE_LMB, CONGE_RMB };
+  conge_event event = { CONGE_EVENT_MOUSE_MOVE };
+  DWORD changed = record->dwButtonState ^ ctx->_record_buttons;
+  int i;
+
+  event.x = record->dwMousePosition.X;
+  event.y = record->dwMousePosition.Y;
+
+  if (record->dwEventFlags & MOUSE_WHEELED)
+    {
+      /* The wheel delta is in the high word. */
+      int scroll = (short) HIWORD (record->dwButtonState);
+
+      event.type = CONGE_EVENT_SCROLL;
+      event.scroll = scroll / abs (scroll); /* clamp between -1 and 1 */
+      conge_read_event (ctx, &event);
+      return;
+    }
+
+  if ((record->dwEventFlags & MOUSE_MOVED) || !changed)
+    conge_read_event (ctx, &event);
+
+  for (i = 0; i < sizeof (buttons) / sizeof (*buttons); i++)
+    if (changed & buttons[i])
+      {
+        event.type = record->dwButtonState & buttons[i]
+          ? CONGE_EVENT_BUTTON_DOWN : CONGE_EVENT_BUTTON_UP;
+        event.code = buttons[i];
+        conge_read_event (ctx, &event);
+      }
+
+  ctx->_record_buttons = record->dwButtonState;
+}
+
+int
+conge_read_console_input (conge_ctx* ctx)
+{
+  INPUT_RECORD records[64];
+  DWORD count, i, j;
+  int read_any = 0;
+
+  /* Drain everything that came since the last read. */
+  while (GetNumberOfConsoleInputEvents (ctx->_input, &count) && count > 0)
+    {
+      if (!ReadConsoleInput (ctx->_input, records,
+                             CONGE_MIN (count, 64), &count))
+        break;
+
+      /* Even resizes count, so that idle contexts redraw. */
+      read_any = 1;
+
+      for (i = 0; i < count; i++)
+        {
+          if (records[i].EventType == KEY_EVENT)
+            {
+              KEY_EVENT_RECORD* record = &records[i].Event.KeyEvent;
+              conge_event event = { CONGE_EVENT_KEY_DOWN };
+
+              event.type = record->bKeyDown
+                ? CONGE_EVENT_KEY_DOWN : CONGE_EVENT_KEY_UP;
+              event.code = record->wVirtualScanCode;
+              conge_read_event (ctx, &event);
+
+              /* Held keys repeat within a single record. */
+              if (record->bKeyDown && record->uChar.AsciiChar != 0)
+                for (j = 0; j < CONGE_MAX (1, record->wRepeatCount); j++)
+                  {
+                    event.type = CONGE_EVENT_CHARACTER;
+                    event.character = (unsigned char) record->uChar.AsciiChar;
+                    conge_read_event (ctx, &event);
+                  }
+            }
+          else if (records[i].EventType == MOUSE_EVENT)
+            conge_read_mouse_record (ctx, &records[i].Event.MouseEvent);
+        }
+    }
+
+  return read_any;
+}
+
+void
+conge_handle_console_input (conge_ctx* ctx)
+{
+  conge_process_mouse (ctx);
+  conge_take_input (ctx);
+}
+
+const conge_backend conge_console_backend =
+  {
+    conge_open_console,
+    conge_close_console,
+    conge_get_window_size,
+    conge_handle_console_input,
+    conge_read_console_input,
+    conge_write_console,
+    conge_console_time,
+    conge_console_sleep,
+    conge_console_wait,
+  };
+
+#endif /* _WIN32 */